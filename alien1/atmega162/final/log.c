@@ -27,6 +27,7 @@
 #define log_mode_waiting    2
 
 uint8_t  log_state, log_substate, log_mode, log_datawait;
+uint8_t  log_block_addressing;
 uint8_t  log_command[6];   /* 1byte command, 4byte argument, 1byte crc */
 uint16_t log_timeout;
 uint32_t log_position, log_position_b;
@@ -43,6 +44,24 @@ uint8_t log_cmd8_expected_response[5] = { 0x01, 0x00, 0x00, 0x01, 0xAA };
 #define SS_HIGH  PORTB |=  (1 << SS)
 #define SS_LOW   PORTB &= ~(1 << SS)
 
+/* Commands and responses go a byte per interrupt: at f/64 (250kHz) until
+ * the card is ready, as it may not go any faster than 400kHz until then,
+ * and at f/16 after. log_burst sends the blocks themselves with the 
+ * interrupt off, at f/2 (SPI2X). */
+#define log_spcr_init   ((1 << SPIE) | (1 << SPE) | (1 << MSTR) | (1 << SPR1))
+#define log_spcr_tick   ((1 << SPIE) | (1 << SPE) | (1 << MSTR) | (1 << SPR0))
+#define log_spcr_burst  ((1 << SPE) | (1 << MSTR))
+#define log_spsr_burst  (1 << SPI2X)
+
+/* Sends a byte and waits for it to go */
+#ifndef log_spi_put
+#define log_spi_put(c)  do                                                   \
+                        {                                                    \
+                          SPDR = (c);                                        \
+                          loop_until_bit_is_set(SPSR, SPIF);                 \
+                        } while (0)
+#endif
+
 /* Every first command-byte starts with 0b01xxxxxx where xxxxxx is a command */
 #define SDCMD(x)  (0x40 | x)
 
@@ -54,6 +73,11 @@ uint8_t log_cmd8_expected_response[5] = { 0x01, 0x00, 0x00, 0x01, 0xAA };
 #define log_quarter_megabyte      0x00040000
 #define log_block_size            512
 
+/* After the superblock, each quarter-megabyte is written in one go as a 
+ * multiple block write (CMD25), pre-erased (ACMD23) and only closed when
+ * it is full or something fails. Between blocks there's just a data token:
+ * no command, no CMD13, and the card can program as it likes. */
+
 /* For more information on this, see the SD Card Association's Physical layer 
  * specification, available easily with no registration on their website. */
 
@@ -66,7 +90,9 @@ ISR(SPI_STC_vect)
 
 void log_tick()
 {
-  uint8_t c, m;
+  uint8_t c;
+  uint16_t n;
+  uint32_t a;
   c = SPDR;
 
   /* If log_mode_commanding is set by the previous state, then that will be 
@@ -184,9 +210,9 @@ void log_tick()
             log_state++;
             log_substate = 0;
 
-            /* Next: Ready Wait: CMD1 */
+            /* Next: Ready Wait: ACMD41, which starts with CMD55 */
             log_mode = log_mode_commanding;
-            log_command[0] = SDCMD(1);
+            log_command[0] = SDCMD(55);
           }
         }
         else
@@ -198,6 +224,28 @@ void log_tick()
         SPDR = 0xFF;
         break;
 
+      case log_state_appcmd:
+        /* ACMD41 is CMD55 then CMD41. The response to CMD55 is 0x01 while
+         * the card is initialising */
+
+        if (c == 0x01 || c == 0x00)
+        {
+          log_state++;
+
+          /* Next: CMD41. HCS: we can do high capacity cards */
+          log_mode = log_mode_commanding;
+          log_command[0] = SDCMD(41);
+          log_command[1] = 0x40;
+        }
+        else
+        {
+          log_state = log_state_deselect;
+          SS_HIGH;
+        }
+
+        SPDR = 0xFF;
+        break;
+
       case log_state_readywait:
         /* This will respond with one byte. If it's 0x01 then it's still 
          * initialising. If it's 0x00 then it's ready. Otherwise, bad 
@@ -205,18 +253,20 @@ void log_tick()
 
         if (c == 0x01)
         {
-          /* Not ready yet; re-send CMD1 */
+          /* Not ready yet; re-send ACMD41 */
+          log_state = log_state_appcmd;
           log_mode = log_mode_commanding;
-          log_command[0] = SDCMD(1);
+          log_command[0] = SDCMD(55);
         }
         else if (c == 0x00)
         {
-          /* Success - It's ready! */
+          /* Success - It's ready! Go full speed */
           log_state++;
+          SPCR = log_spcr_tick;
 
-          /* Next: Read Superblock */
+          /* Next: Read the OCR (CMD58) */
           log_mode = log_mode_commanding;
-          log_command[0] = SDCMD(17);
+          log_command[0] = SDCMD(58);
         }
         else
         {
@@ -227,6 +277,40 @@ void log_tick()
         SPDR = 0xFF;
         break;
 
+      case log_state_readocr:
+        /* Expected response: 0x00, then the 4 byte OCR. Bit 30 of it (CCS)
+         * says that this is a high capacity card, which is addressed in 
+         * blocks rather than bytes */
+
+        if (log_substate == 0 && c != 0x00)
+        {
+          log_state = log_state_deselect;
+          SS_HIGH;
+          SPDR = 0xFF;
+          break;
+        }
+
+        if (log_substate == 1)
+        {
+          log_block_addressing = c & 0x40;
+        }
+
+        log_substate++;
+
+        if (log_substate == 5)
+        {
+          /* Success */
+          log_state++;
+          log_substate = 0;
+
+          /* Next: Read Superblock (block 0 either way) */
+          log_mode = log_mode_commanding;
+          log_command[0] = SDCMD(17);
+        }
+
+        SPDR = 0xFF;
+        break;
+
       case log_state_readsuper_r:
         /* Expected response: single byte; 0x00 */
 
@@ -356,44 +440,22 @@ void log_tick()
         #undef log_position_substate
 
       case log_state_idle:
-      case log_state_write_data:
-        /* Next: Write a block. But where? */
+        /* Next: Start a quarter-megabyte by updating the superblock - write
+         * block 0 (CMD24, address 0) */
         log_mode = log_mode_commanding;
         log_command[0] = SDCMD(24);
+        log_state = log_state_writing_super;
 
-        /* Are we about to start a new quarter-megabyte? 
-         * If we are, have we already written the superblock?
-         * (check log_state == _write_data) */
-        if ((log_position & log_quarter_megabyte_mask) || 
-            (log_state == log_state_write_data))
-        {
-          /* Unpack to log_command, solving endianness. This 
-           * actually produces very nice assembly with -O2,
-           * gcc optimises it the 4 loads and 4 saves you'd expect */
-          log_command[1] = (log_position & 0xFF000000) >> 24;
-          log_command[2] = (log_position & 0x00FF0000) >> 16;
-          log_command[3] = (log_position & 0x0000FF00) >> 8;
-          log_command[4] = (log_position & 0x000000FF); 
+        /* The superblock contains the address to start writing at.
+         * We're starting this quarter-megabyte. If we crash we want
+         * to start writing at the next quarter-meg, since this one
+         * will be partially written. */
+        log_position_b = log_position + log_quarter_megabyte;
 
-          log_state = log_state_writing_data;
-          log_position += log_block_size;
-        }
-        else
+        /* Prepare for the data: don't write it over block 0 */
+        if (log_position == 0)
         {
-          /* Update the superblock - write block 0 */
-          log_state = log_state_writing_super;
-
-          /* The superblock contains the address to start writing at.
-           * We're starting this quarter-megabyte. If we crash we want
-           * to start writing at the next quarter-meg, since this one
-           * will be partially written. */
-          log_position_b = log_position + log_quarter_megabyte;
-
-          /* Prepare for next time round: don't write data over block 0 */
-          if (log_position == 0)
-          {
-            log_position = log_block_size;
-          }
+          log_position = log_block_size;
         }
 
         SPDR = 0xFF;
@@ -401,15 +463,25 @@ void log_tick()
 
       case log_state_writing_super:
       case log_state_writing_data:
-        /* Expect 0x00 to acknowledge write command, then send 0xFE (data
-         * token), then send data. */
+        /* Expect 0x00 to acknowledge the write command (CMD24 or CMD25),
+         * then send the data token (Start Block or, for CMD25, Start Block
+         * Multi), then send data. */
         if (log_substate == 0)
         {
           if (c == 0x00)
           {
             /* Good, now transmit data token... */
-            SPDR = 0xFE;
             log_substate = 1;
+
+            if (log_state == log_state_writing_super)
+            {
+              SPDR = 0xFE;
+            }
+            else
+            {
+              SPDR = 0xFC;
+              log_position += log_block_size;
+            }
           }
           else
           {
@@ -426,51 +498,26 @@ void log_tick()
            * To save .text and .bss space, we repurpose log_timeout. */
           #define log_writing_substate  log_timeout
 
-          if (log_state == log_state_writing_super)
+          if (log_writing_substate < log_block_size)
           {
-            if (log_writing_substate < 12)
+            /* Hand over to log_burst, which is called from the main loop.
+             * Don't set SPDR: the loop will pause until it's done */
+            if (log_state == log_state_writing_super)
             {
-              /* log_position_b will have been prepared with the value to 
-               * write. (value & 0x03) == (value % 4), but & is faster */
-              SPDR = ba(log_position_b)[ (log_writing_substate) & 0x03 ];
+              log_state = log_state_burst_super;
             }
             else
             {
-              /* Stuff bytes */
-              SPDR = 0x00;
+              log_state = log_state_burst_data;
             }
 
-            log_writing_substate++; 
-          }
-          else
-          {
-            /* writing_data */
-            if (log_writing_substate < log_block_size)
-            {
-              m = messages_get_char(&log_data);
-
-              /* If it's the end of the message, don't set SPDR, the loop will
-               * pause, and when log_start is called fresh data will be ready */
-              if (m != 0)
-              {
-                SPDR = m;
-                log_writing_substate++; 
-              }
-              else
-              {
-                /* Temporary state - log_start() will restore our state
-                 * to writing data; preserve substate and co */
-                log_state = log_state_datawait;
-              }
-            }
-            else
-            {
-              /* Two ignored CRCs */
-              SPDR = 0x00;
-              log_writing_substate++; 
-            }
+            break;
           }
 
+          /* Two ignored CRCs */
+          SPDR = 0x00;
+          log_writing_substate++; 
+
           /* +2: 2 crcs, ignored */
           if (log_writing_substate == log_block_size + 2)
           {
@@ -487,26 +534,53 @@ void log_tick()
 
       case log_state_writewait_super:
       case log_state_writewait_data:
-        /* Expected: 0x*5 */
+        /* Expected: 0bxxx00101 (data accepted), then 0x00 until it's done */
         if (log_substate == 0)
         {
-          if ((c & 0x0F) == 0x05)
+          if ((c & 0x1F) == 0x05)
           {
             /* Now we wait for the write to finish */
             log_substate = 1;
           }
+          else
+          {
+            /* Rejected (CRC or write error) */
+            log_state = log_state_deselect;
+            SS_HIGH;
+          }
         }
         else
         {
           if (c == 0xFF)
           {
             /* Success! */
-            log_state++;
             log_substate = 0;
 
-            /* Next: Check Status (CMD13) */
-            log_mode = log_mode_commanding;
-            log_command[0] = SDCMD(13);
+            if (log_state == log_state_writewait_super)
+            {
+              /* Next: Check Status (CMD13) */
+              log_state++;
+              log_mode = log_mode_commanding;
+              log_command[0] = SDCMD(13);
+            }
+            else if (log_position & log_quarter_megabyte_mask)
+            {
+              /* There's more of this quarter-megabyte: keep the CMD25 open
+               * and go straight on to the next block's data token */
+              messages_set_log_ok();
+              log_state = log_state_writing_data;
+              log_substate = 1;
+              log_position += log_block_size;
+              SPDR = 0xFC;
+              break;
+            }
+            else
+            {
+              /* It's full. Close the CMD25 (Stop Tran token) */
+              log_state = log_state_stop;
+              SPDR = 0xFD;
+              break;
+            }
           }
           else if (c != 0x00)
           {
@@ -519,6 +593,30 @@ void log_tick()
         SPDR = 0xFF;
         break;
 
+      case log_state_stop:
+        /* Skip the byte sent with the token and one more, after which the 
+         * card is busy (0x00) until it has finished programming */
+        if (log_substate < 2)
+        {
+          log_substate++;
+        }
+        else if (c == 0xFF)
+        {
+          /* Next: Check Status (CMD13) */
+          log_state++;
+          log_substate = 0;
+          log_mode = log_mode_commanding;
+          log_command[0] = SDCMD(13);
+        }
+        else if (c != 0x00)
+        {
+          log_state = log_state_deselect;
+          SS_HIGH;
+        }
+
+        SPDR = 0xFF;
+        break;
+
       case log_state_writecheck_super:
       case log_state_writecheck_data:
         /* Expected Response: 0x00, 0x00 */
@@ -536,12 +634,14 @@ void log_tick()
 
             if (log_state == log_state_writecheck_super)
             {
-              /* Super: ok, now write data */
-              log_state = log_state_write_data;
+              /* Super: ok, now pre-erase: CMD55, ACMD23 */
+              log_state = log_state_preerase;
+              log_mode = log_mode_commanding;
+              log_command[0] = SDCMD(55);
             }
             else
             {
-              /* Continue and write another block */
+              /* Quarter-megabyte done: start the next one */
               log_state = log_state_idle;
             }
           }
@@ -555,15 +655,159 @@ void log_tick()
         SPDR = 0xFF;
         break;
 
+      case log_state_preerase:
+        /* Response to CMD55 should be 0x00 */
+        if (c == 0x00)
+        {
+          log_state++;
+
+          /* Next: ACMD23, the number of blocks we're about to write. That's
+           * the rest of this quarter-megabyte, which the card can now erase 
+           * in one go before the first block rather than as it goes */
+          n = (log_quarter_megabyte - 
+               (log_position & log_quarter_megabyte_mask)) / log_block_size;
+
+          log_mode = log_mode_commanding;
+          log_command[0] = SDCMD(23);
+          log_command[3] = n >> 8;
+          log_command[4] = n & 0xFF;
+        }
+        else
+        {
+          log_state = log_state_deselect;
+          SS_HIGH;
+        }
+
+        SPDR = 0xFF;
+        break;
+
+      case log_state_write_data:
+        /* Pre-erasing only affects speed, so whatever the response to ACMD23
+         * was, carry on. Next: Start streaming (CMD25). log_position is 
+         * always in bytes (the superblock holds one too), but high capacity
+         * cards want a block number */
+        a = log_position;
+
+        if (log_block_addressing)
+        {
+          a /= log_block_size;
+        }
+
+        /* Unpack to log_command, solving endianness. This actually produces
+         * very nice assembly with -O2, gcc optimises it the 4 loads and 4 
+         * saves you'd expect */
+        log_state++;
+        log_mode = log_mode_commanding;
+        log_command[0] = SDCMD(25);
+        log_command[1] = (a & 0xFF000000) >> 24;
+        log_command[2] = (a & 0x00FF0000) >> 16;
+        log_command[3] = (a & 0x0000FF00) >> 8;
+        log_command[4] = (a & 0x000000FF); 
+
+        SPDR = 0xFF;
+        break;
+
       case log_state_deselect:
         /* Something broke. Deselect and go back to the beginning */
         log_state = log_state_initreset;
+        SPCR = log_spcr_init;
         messages_clear_log_ok();
         break;
     }
   }
 }
 
+/* Sends the block that log_tick has handed over: all of the superblock, or
+ * as much of a data block as there is data for (one message, or the rest
+ * of one, at a time). It's a tight loop with the SPI interrupt off, so it 
+ * runs here rather than in an ISR; the radio and gps can interrupt it. */
+void log_burst()
+{
+  uint8_t *data;
+  uint8_t length;
+  uint16_t i, n;
+
+  /* See log_tick */
+  #define log_writing_substate  log_timeout
+
+  if (log_state != log_state_burst_super && 
+      log_state != log_state_burst_data)
+  {
+    return;
+  }
+
+  SPCR = log_spcr_burst;
+  SPSR = log_spsr_burst;
+
+  n = log_block_size - log_writing_substate;
+
+  if (log_state == log_state_burst_super)
+  {
+    /* log_position_b will have been prepared with the value to write;
+     * it goes three times (see _readsuper_d) and the rest is stuffing. 
+     * (value & 0x03) == (value % 4), but & is faster */
+    for (i = 0; i < 12; i++)
+    {
+      log_spi_put(ba(log_position_b)[i & 0x03]);
+    }
+
+    for (; i < n; i++)
+    {
+      log_spi_put(0x00);
+    }
+  }
+  else
+  {
+    /* The rendered message goes straight out of its buffer */
+    data = messages_peek(&log_reader, &length);
+
+    if (length < n)
+    {
+      n = length;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+      log_spi_put(data[i]);
+    }
+  }
+
+  /* The ISRs use these too */
+  cli();
+
+  log_writing_substate += n;
+
+  if (log_state == log_state_burst_super)
+  {
+    log_state = log_state_writing_super;
+  }
+  else
+  {
+    messages_skip(&log_reader, n);
+
+    if (log_writing_substate == log_block_size)
+    {
+      log_state = log_state_writing_data;
+    }
+    else
+    {
+      /* Temporary state - log_start() will restore our state to writing
+       * data when there's a fresh message; preserve substate and co */
+      log_state = log_state_datawait;
+    }
+  }
+
+  /* SPIF is still set from the last byte, so the ISR goes off straight 
+   * away and carries on (with the CRCs) from the new state. If the message
+   * had already run out nothing was sent, and it won't. */
+  SPSR = 0;
+  SPCR = log_spcr_tick;
+
+  sei();
+
+  #undef log_writing_substate
+}
+
 void log_start()
 {
   if (log_state == log_state_datawait)
@@ -581,8 +825,8 @@ void log_init()
   PORTB |=  (1 << MISO);
   SS_HIGH;
 
-  /* Setup SPI: Interrupts on, SPI on, Master on, MSB first, Speed: f/16 */
-  SPCR = ((1 << SPIE) | (1 << SPE) | (1 << MSTR) | (1 << SPR0));
+  /* Setup SPI: Interrupts on, SPI on, Master on, MSB first, Speed: f/64 */
+  SPCR = log_spcr_init;
 
   /* The ISR will set SPDR, which will in turn cause another interrupt after
    * that byte is transferred. log_start begins this loop. When it is done
@@ -21,21 +21,27 @@
 #define log_state_initreset        0    /* Init - 80 clocks */
 #define log_state_reset            1    /* Send reset - CMD0, check */
 #define log_state_getocr           2    /* Check voltage info - CMD8 */
-#define log_state_readywait        3    /* Send CMD1 until it's ready */
-#define log_state_readsuper_r      4    /* Read Superblock - Response */
-#define log_state_readsuper_s      5    /* Read Superblock - Data Token */
-#define log_state_readsuper_d      6    /* Read Superblock - Data! */
-#define log_state_idle             7    /* Waiting for data, write CMD24 */
-#define log_state_writing_super    8    /* Writing superblock */
-#define log_state_writewait_super  9    /* Waiting for write finish */
-#define log_state_writecheck_super 10   /* CMD13: Check status */
-#define log_state_write_data       11   /* Write data CMD24 */
-#define log_state_writing_data     12   /* Writing data */
-#define log_state_writewait_data   13   /* Waiting for write finish */
-#define log_state_writecheck_data  14   /* CMD13: Check status */
-
-#define log_state_datawait         15   /* Temporary state */
-#define log_state_deselect         16   /* Wind down, end loop, goto 0 */
+#define log_state_appcmd           3    /* CMD55, ACMD41 follows */
+#define log_state_readywait        4    /* Send ACMD41 until it's ready */
+#define log_state_readocr          5    /* CMD58: Block addressing? */
+#define log_state_readsuper_r      6    /* Read Superblock - Response */
+#define log_state_readsuper_s      7    /* Read Superblock - Data Token */
+#define log_state_readsuper_d      8    /* Read Superblock - Data! */
+#define log_state_idle             9    /* Start a quarter-meg: CMD24 */
+#define log_state_writing_super    10   /* Writing superblock */
+#define log_state_writewait_super  11   /* Waiting for write finish */
+#define log_state_writecheck_super 12   /* CMD13: Check status */
+#define log_state_preerase         13   /* Pre-erase the rest: ACMD23 */
+#define log_state_write_data       14   /* Start streaming: CMD25 */
+#define log_state_writing_data     15   /* Writing data */
+#define log_state_writewait_data   16   /* Waiting for write finish */
+#define log_state_stop             17   /* Stop Tran token, wait */
+#define log_state_writecheck_data  18   /* CMD13: Check status */
+
+#define log_state_datawait         19   /* Temporary state */
+#define log_state_deselect         20   /* Wind down, end loop, goto 0 */
+#define log_state_burst_super      21   /* log_burst: writing superblock */
+#define log_state_burst_data       22   /* log_burst: writing data */
 
 #define log_timeout_max          250    /* Don't hang around */
 #define log_timeout_write_max    4000 
@@ -45,6 +51,7 @@ extern uint8_t log_datawait;
 
 void log_start();
 void log_tick();
+void log_burst();
 void log_init();
 
 #endif 
@@ -41,7 +41,14 @@ int main()
   /* Interrupts on - go go go! */
   sei();
 
-  /* Now sleep - the whole program is interrupt driven */
-  for (;;) sleep_mode();
+  /* Now sleep - the whole program is interrupt driven, except for writing
+   * blocks to the log, which the SPI ISR leaves to us. If an ISR hands one
+   * over just before sleep_mode, the next interrupt (at most 20ms) will 
+   * wake us for it. */
+  for (;;)
+  {
+    sleep_mode();
+    log_burst();
+  }
 }
 
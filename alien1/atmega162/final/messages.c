@@ -15,6 +15,7 @@
     see <http://www.gnu.org/licenses/>.
 */
 
+#include <avr/pgmspace.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -25,339 +26,313 @@
 #include "radio.h"
 #include "sms.h"
 
-/* NOTE: messages.h has a hardcoded max-length for messages, which must be 
- * kept up to date! */
+/* NOTE: the formats are in messages.h, which works out messages_max_length
+ * from them. */
 
 /* NOTE: messages.c is expected to only use alphanumeric and .,:-$!* chars,
  * and a newline. The only problem char is the $ which has a different
  * code in the GSM alphabet (see sms.c) */
 
-/* $$A1,<INCREMENTAL COUNTER ID>,<TIME HH:MM:SS>,<N-LATITUDE DD.DDDDDD>,
- * <E-LONGITUDE DDD.DDDDDD>,<ALTITUDE METERS MMMMM>,<GPS_FIX_AGE_HEXDUMP>,
- * <GPS_SAT_COUNT>,<TEMPERATURE_HEXDUMP>,<MCUCSR,GPS_RX_OK HEXDUMP>
- * *<CHECKSUM><NEWLINE> */
+/* messages_field.op */
+#define messages_op_end       0
+#define messages_op_lit       1
+#define messages_op_mark      2
+#define messages_op_raw       3
+#define messages_op_hex       4
+#define messages_op_hexr      5
+#define messages_op_dec       6
+#define messages_op_neg       7
+#define messages_op_checksum  8
+
+#define messages_field_program(op, src, width, delim)                        \
+                          { messages_op_ ## op, (src), (width), (delim) },
+
+const messages_field messages_a1[] PROGMEM = 
+  { messages_format_a1(messages_field_program)
+    { messages_op_end, 0, 0, 0 } };
 
 /* Message Buffers: see messages.h for more info */
-payload_message latest_data, log_data, radio_data, sms_data;
-
-/* payload_message.message_send_field */
-#define message_send_field_flagstart_a 0
-#define message_send_field_flagstart_b 1
-#define message_send_field_header      2
-#define message_send_field_inccnt      3
-#define message_send_field_gpstime_hh  4
-#define message_send_field_gpstime_mm  5
-#define message_send_field_gpstime_ss  6
-#define message_send_field_gpslat_sign 7
-#define message_send_field_gpslat_d    8
-#define message_send_field_gpslat_p    9
-#define message_send_field_gpslon_sign 10
-#define message_send_field_gpslon_d    11
-#define message_send_field_gpslon_p    12
-#define message_send_field_gpsalt      13  /* Ukhas protocol finishes here */
-#define message_send_field_gpsfixage   14
-#define message_send_field_gpssatc     15
-#define message_send_field_temperature 16 
-#define message_send_field_state       17
-#define message_send_field_checksum    18
-#define message_send_field_nl          19
-#define message_send_field_end         20
-
-/* fcname: flight computer name, name of our balloon */
-uint8_t message_header[2] = { 'A', '1' };
+payload_message latest_data;
+messages_reader radio_reader = { messages_a1 };
+messages_reader   log_reader = { messages_a1 };
+messages_reader   sms_reader = { messages_a1 };
+
+/* Each sentence is rendered once, when messages_push finds a consumer 
+ * ready for it (in that consumer's format), and then shared: every reader
+ * with the same format takes it that second, keeps its own position, and
+ * the last one to finish frees it. The ISRs that do this (timer1's, the
+ * SPI's and USART1's) don't nest, so need no locking; but log_burst peeks
+ * and skips from the main loop. A reader's sentence isn't freed until it
+ * has skipped to the end, so peeking is safe anywhere, but the counting
+ * isn't: main loop callers must clear interrupts around messages_skip,
+ * as log_burst does. */
+messages_sentence messages_sentences[messages_sentence_count];
 
 /* powten: look up table for reverse powers of 10 */
 uint16_t powten[5] = { 10000, 1000, 100, 10, 1 };
 
-/* Scopy: Simple copy. */
-
-/* Raw scopy */
-#define   scopyr(source, length, type)                                    \
-        (scopy_src = (source), scopy_length = (length), scopy_type = (type))
+/* Runs a format program over latest_data, into s */
+void messages_run(messages_sentence *s, const messages_field *field)
+{
+  uint8_t op, width, delim, i, c;
+  uint8_t *src, *p, *mark;
+  uint16_t value;
+  div_t divbuf;
 
-/* Derivatives */
-#define    scopy(source)                                                  \
-              scopyr(   source,  sizeof(source),     scopy_type_rawcopy)
-#define   scopys(source, length)                                          \
-              scopyr(   source,  length,             scopy_type_rawcopy)
-#define  scopyhd(source)                                                  \
-              scopyr(ba(source), sizeof(source) * 2, scopy_type_hexdump)
+  p = s->data;
+  mark = p;
 
-/* scopy types */
-#define scopy_type_null        0x00
-#define scopy_type_rawcopy     0x01
-#define scopy_type_hexdump     0x02
+  for (;;)
+  {
+    op    = pgm_read_byte(&(field->op));
+    src   = ba(latest_data) + pgm_read_byte(&(field->src));
+    width = pgm_read_byte(&(field->width));
+    delim = pgm_read_byte(&(field->delim));
+    field++;
 
-/* Gets the next character to send */
-uint8_t messages_get_char(payload_message *data)
-{
-  uint8_t c;               /* Char to return */
-  uint8_t i, j, k, l, t;   /* Temporary Variables */
-  div_t divbuf;            /* Temporary divide result storage */
-  uint8_t field_delim;
+    switch (op)
+    {
+      case messages_op_end:
+        s->length = p - s->data;
+        return;
 
-  /* scopy enabling values */
-  uint8_t *scopy_src;
-  uint8_t  scopy_length;
-  uint8_t  scopy_type;
+      case messages_op_mark:
+        mark = p;
+        break;
 
-  /* Initialise to false */
-  c = 0;
-  scopy_type = 0;
+      case messages_op_raw:
+        for (i = 0; i < width; i++)
+        {
+          c = src[i];
 
-  /* By default each field is separated by a comma */
-  field_delim = ',';
+          if (c == 0)
+          {
+            /* This may happen for the first few messages where there is
+             * no gps data */
+            c = '!';
+          }
 
-  switch (data->message_send_field)
-  {
-    case message_send_field_flagstart_a:
-    case message_send_field_flagstart_b:
-      c = '$';
-      data->message_send_field++;
-      break;
+          *p++ = c;
+        }
+        break;
 
-    case message_send_field_header:
-      scopy(message_header);
-      break;
+      case messages_op_hex:
+        for (i = 0; i < width; i++)
+        {
+          *p++ = hexdump_a(src[i]);
+          *p++ = hexdump_b(src[i]);
+        }
+        break;
 
-    case message_send_field_inccnt:
-      /* Modified integer to ascii follows */
+      case messages_op_hexr:
+        /* Compensate for the endian-ness */
+        for (i = width; i != 0; i--)
+        {
+          *p++ = hexdump_a(src[i - 1]);
+          *p++ = hexdump_b(src[i - 1]);
+        }
+        break;
 
-      if (data->message_send_fsubstate == 5)
-      {
-        c = field_delim;
-        data->message_send_field++;
-        data->message_send_fsubstate = 0;
-      }
-      else
-      {
-        /* Time for some magic. Divide 10^n into message_id *
-         * gets stored in message_id */
-        divbuf = udiv(data->message_id, powten[data->message_send_fsubstate]);
+      case messages_op_dec:
+        /* Modified integer to ascii: divide 10^n into what's left of the 
+         * value, the quotient is the digit and the remainder goes onto
+         * the next */
+        value = *((uint16_t *) src);
 
-        /* Quotient is the current digit:
-         * Start at '0' and count up to '1' ... */
-        c = '0' + divbuf.quot;
+        for (i = sizeof(powten) / sizeof(powten[0]) - width; 
+             i < sizeof(powten) / sizeof(powten[0]); i++)
+        {
+          divbuf = udiv(value, powten[i]);
+          *p++ = '0' + divbuf.quot;
+          value = divbuf.rem;
+        }
+        break;
 
-        /* Remainder gets stored in message_id for the next pass */
-        data->message_id = divbuf.rem;
+      case messages_op_neg:
+        if (*src & width)
+        {
+          *p++ = '-';
+        }
+        break;
 
-        /* Move onto a lesser digit (powten counts powers down) */
-        data->message_send_fsubstate++;
-      }
+      case messages_op_checksum:
+        /* NMEA-style xor-checksum */
+        c = 0;
 
-      break;
+        while (mark != p)
+        {
+          c ^= *mark;
+          mark++;
+        }
 
-    case message_send_field_gpstime_hh:
-      scopys(data->system_location.time    , 2);
-      field_delim = ':';
-      break;
+        *p++ = '*';
+        *p++ = hexdump_a(c);
+        *p++ = hexdump_b(c);
+        break;
+    }
 
-    case message_send_field_gpstime_mm:
-      scopys(data->system_location.time + 2, 2);
-      field_delim = ':';
-      break;
+    if (delim != 0)
+    {
+      *p++ = delim;
+    }
+  }
+}
 
-    case message_send_field_gpstime_ss:
-      scopys(data->system_location.time + 4, 2);
-      break;
+/* Renders latest_data into a free sentence; NULL if there isn't one */
+messages_sentence *messages_render(const messages_field *format)
+{
+  messages_sentence *s;
+  uint8_t i;
 
-    case message_send_field_gpslat_sign:
-      /* Whatever happens, we'll be moving onto the next field */
-      data->message_send_field++;
+  for (i = 0; i < messages_sentence_count; i++)
+  {
+    s = &messages_sentences[i];
 
-      if (data->system_location.flags & gps_cflag_south)
-      {
-         c = '-';   /* Negative sign for southern latitude */
-         break;
-      }
+    if (s->users == 0)
+    {
+      messages_run(s, format);
+      s->format = format;
+      s->fresh = 1;
+      return s;
+    }
+  }
 
-      /* Otherwise, fall through to the next field: no break */
+  return NULL;
+}
 
-    case message_send_field_gpslat_d:
-      scopy(data->system_location.lat_d);
-      field_delim = '.';
-      break;
+/* Let go of the reader's sentence, if it has one */
+void messages_release(messages_reader *reader)
+{
+  if (reader->sentence != NULL)
+  {
+    reader->sentence->users--;
+    reader->sentence = NULL;
+  }
+}
 
-    case message_send_field_gpslat_p:
-      scopy(data->system_location.lat_p);
-      break;
+/* Gives the reader this second's sentence in its format, rendering it if
+ * need be. Returns 0 if there isn't one to give. */
+uint8_t messages_take(messages_reader *reader)
+{
+  messages_sentence *s;
+  uint8_t i;
 
-    case message_send_field_gpslon_sign:
-      data->message_send_field++;
+  /* If it gave up part way through (e.g., the log reset) it won't be 
+   * back for the rest */
+  messages_release(reader);
 
-      if (data->system_location.flags & gps_cflag_west)
-      {
-        c = '-';
-        break;
-      }
+  for (i = 0; i < messages_sentence_count; i++)
+  {
+    s = &messages_sentences[i];
 
-    case message_send_field_gpslon_d:
-      scopy(data->system_location.lon_d);
-      field_delim = '.';
+    if (s->fresh && s->format == reader->format)
+    {
       break;
+    }
+  }
 
-    case message_send_field_gpslon_p:
-      scopy(data->system_location.lon_p);
-      break;
+  if (i == messages_sentence_count)
+  {
+    s = messages_render(reader->format);
 
-    case message_send_field_gpsalt:
-      scopy(data->system_location.alt);
-      break;
+    if (s == NULL)
+    {
+      return 0;
+    }
+  }
 
-    case message_send_field_gpsfixage:
-      /* Compensate for the endian-ness */
-      if (data->message_send_fsubstate == 4)
-      {
-        c = field_delim;
-        data->message_send_field++;
-        data->message_send_fsubstate = 0;
-      }
-      else
-      {
-        if (data->message_send_fsubstate < 2)
-        {
-          t = (data->system_fix_age & 0xFF00) >> 8;
-        }
-        else
-        {
-          t =  data->system_fix_age & 0x00FF;
-        }
+  reader->sentence = s;
+  reader->position = 0;
+  s->users++;
 
-        /* Is it even or odd? if bit 1 is clear it is even */
-        if (!(data->message_send_fsubstate & 0x01))
-        {
-          i =  last_four(t);
-        }
-        else
-        {
-          i = first_four(t);
-        }
+  return 1;
+}
 
-        c = num_to_char(i);
-        data->message_send_fsubstate++;
-      }
+/* Gets the next character to send, or 0 at the end of the sentence */
+uint8_t messages_get_char(messages_reader *reader)
+{
+  messages_sentence *s;
+  uint8_t c;
 
-      break;
+  s = reader->sentence;
 
-    case message_send_field_gpssatc:
-      scopy(data->system_location.satc);
-      break;
+  if (s == NULL)
+  {
+    return 0;
+  }
 
-    case message_send_field_temperature:
-      scopyhd(data->system_temp);
-      break;
+  c = s->data[reader->position];
+  reader->position++;
 
-    case message_send_field_state:
-      scopyhd(data->system_state);
-      field_delim = '*';   /* Checksum starts with a '*' */
-      break;
+  if (reader->position == s->length)
+  {
+    messages_release(reader);
+  }
 
-    case message_send_field_checksum:
-      if (data->message_send_fsubstate == 0)
-      {
-        l =  last_four(data->message_send_checksum);
-        data->message_send_fsubstate++;
-      }
-      else
-      {
-        l = first_four(data->message_send_checksum);
-        data->message_send_field++;
-        data->message_send_fsubstate = 0;
-      }
-
-      c = num_to_char(l);
-      break;
+  return c;
+}
 
-    case message_send_field_nl:
-      c = '\n';
-      data->message_send_field++;
-      break;
+/* For a consumer that wants the rest of its sentence in one go: returns
+ * where it is, and how long it is in length (0 if there isn't one) */
+uint8_t *messages_peek(messages_reader *reader, uint8_t *length)
+{
+  messages_sentence *s;
 
-    case message_send_field_end:
-    default:
-      return 0; /* Tells parent function that it is the end of transmission */
-      break;
-  }
+  s = reader->sentence;
 
-  if (scopy_type != scopy_type_null)
+  if (s == NULL)
   {
-    /* The scopy macro will double scopy_len if it is in hexdump mode */
-    if (data->message_send_fsubstate == scopy_length) 
-    {
-      c = field_delim;
-      data->message_send_field++;
-      data->message_send_fsubstate = 0;
-    } 
-    else  
-    {
-      if (scopy_type == scopy_type_hexdump)
-      {
-        /* value & 0x01 is true if value is odd, 
-         * value >> 1 divides by two, discarding remainder */
-        k = scopy_src[data->message_send_fsubstate >> 1];
-
-        if (!(data->message_send_fsubstate & 0x01)) 
-        {
-          j =  last_four(k); 
-        }
-        else
-        {
-          j = first_four(k); 
-        }
-
-        c = num_to_char(j); 
-        data->message_send_fsubstate++;
-      }
-      else
-      {
-        c = scopy_src[data->message_send_fsubstate];
-        data->message_send_fsubstate++;
-      }
-    }
+    *length = 0;
+    return NULL;
   }
 
-  if (c == 0)
+  *length = s->length - reader->position;
+  return s->data + reader->position;
+}
+
+/* ...and then marks n (at most length) chars of it as sent. Call it with
+ * interrupts off if outside of an ISR, as messages_push may be running */
+void messages_skip(messages_reader *reader, uint8_t n)
+{
+  if (n == 0)
   {
-    /* Shouldn't == 0 if we haven't returned already. This may happen for the
-     * first few messages where there is no gps data */
-    c = '!';
+    return;
   }
 
-  if (data->message_send_field < message_send_field_checksum)
-  {
-    /* If: the current char is before the checksum (we don't wanna check the
-     * the * or the checksum itself) AND it's not the first two chars of 
-     * the header (we exclude the $$) then compute a NMEA-style xor-checksum */
+  reader->position += n;
 
-    data->message_send_checksum ^= c;
+  if (reader->position == reader->sentence->length)
+  {
+    messages_release(reader);
   }
-
-  return c;
 }
 
 /* Called every second, a signal to push the data onwards */
 void messages_push()
 {
-  if (radio_state == radio_state_not_txing)
+  uint8_t i;
+
+  for (i = 0; i < messages_sentence_count; i++)
+  {
+    messages_sentences[i].fresh = 0;
+  }
+
+  if (radio_state == radio_state_not_txing && messages_take(&radio_reader))
   {
-    /* Update the radio's copy, and begin transmission! */
-    memcpy(&radio_data, &latest_data, sizeof(payload_message));
+    /* Begin transmission! */
     radio_send();
   }
 
-  if (log_state == log_state_initreset || log_state == log_state_datawait)
+  if ((log_state == log_state_initreset || 
+       log_state == log_state_datawait) && messages_take(&log_reader))
   {
-    memcpy(&log_data,   &latest_data, sizeof(payload_message));
     log_start();
   }
 
-  if (sms_mode == sms_mode_data)
+  if (sms_mode == sms_mode_data && messages_take(&sms_reader))
   {
-    memcpy(&sms_data,   &latest_data, sizeof(payload_message));
     sms_mode = sms_mode_rts;
   }
 
   latest_data.message_id++;
 }
-
@@ -18,13 +18,10 @@
 #ifndef ALIEN_MESSAGES_HEADER
 #define ALIEN_MESSAGES_HEADER
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 
-/* Hardcoded messages max length. Since the length of a message can vary, this
- * specifies the maximum, or a near-maximum. This _must_ be kept up-to-date! */
-#define messages_max_length 75
-
 /* GPS data struct */
 #define gps_cflag_north  0x01
 #define gps_cflag_south  0x02
@@ -63,11 +60,109 @@ typedef struct
   temperature_data system_temp;     /* Hexdump this */
   uint8_t system_state;             /* 7 - MCUCSR-WDT, 6 - log_ok, 
                                        3..0 - gps_rx_ok */
-  uint8_t message_send_field;       /* These help out the message.c */
-  uint8_t message_send_fsubstate;
-  uint8_t message_send_checksum;
 } payload_message;
 
+/* Sentence formats. Each is a list of fields, F(op, src, width, delim),
+ * which messages.c turns into a program in flash and runs to render a
+ * sentence; the same list gives its maximum length at compile time. 
+ * Each op outputs (at most) the chars below, and then delim unless it's 0.
+ *
+ *   lit      nothing (so just the delim)
+ *   mark     nothing; the checksum starts here
+ *   raw      width chars at src, as they are ('!' for a 0)
+ *   hex      width bytes at src, hexdumped in order
+ *   hexr     same, but last byte first (i.e., a uint16_t MSB first)
+ *   dec      the uint16_t at src in width (at most 5) digits, zero padded
+ *   neg      '-' if the byte at src has any of the bits in width set
+ *   checksum '*' and the xor of every char since the mark, hexdumped
+ *
+ * src is an offset into payload_message: use messages_at(field). */
+#define messages_at(field)  offsetof(payload_message, field)
+
+/* $$A1,<INCREMENTAL COUNTER ID>,<TIME HH:MM:SS>,<N-LATITUDE DD.DDDDDD>,
+ * <E-LONGITUDE DDD.DDDDDD>,<ALTITUDE METERS MMMMM>,<GPS_FIX_AGE_HEXDUMP>,
+ * <GPS_SAT_COUNT>,<TEMPERATURE_HEXDUMP>,<MCUCSR,GPS_RX_OK HEXDUMP>
+ * *<CHECKSUM><NEWLINE> 
+ * Everything up to the altitude is the ukhas protocol. */
+#define messages_format_a1(F)                                                \
+  F(lit,      0,                                   0, '$')                   \
+  F(lit,      0,                                   0, '$')                   \
+  F(mark,     0,                                   0, 0)                     \
+  F(lit,      0,                                   0, 'A')                   \
+  F(lit,      0,                                   0, '1')                   \
+  F(lit,      0,                                   0, ',')                   \
+  F(dec,      messages_at(message_id),             5, ',')                   \
+  F(raw,      messages_at(system_location.time),   2, ':')                   \
+  F(raw,      messages_at(system_location.time[2]), 2, ':')                  \
+  F(raw,      messages_at(system_location.time[4]), 2, ',')                  \
+  F(neg,      messages_at(system_location.flags),                            \
+                                       gps_cflag_south, 0)                   \
+  F(raw,      messages_at(system_location.lat_d),  2, '.')                   \
+  F(raw,      messages_at(system_location.lat_p),  6, ',')                   \
+  F(neg,      messages_at(system_location.flags),                            \
+                                       gps_cflag_west, 0)                    \
+  F(raw,      messages_at(system_location.lon_d),  3, '.')                   \
+  F(raw,      messages_at(system_location.lon_p),  6, ',')                   \
+  F(raw,      messages_at(system_location.alt),    5, ',')                   \
+  F(hexr,     messages_at(system_fix_age),         2, ',')                   \
+  F(raw,      messages_at(system_location.satc),   2, ',')                   \
+  F(hex,      messages_at(system_temp),            4, ',')                   \
+  F(hex,      messages_at(system_state),           1, 0)                     \
+  F(checksum, 0,                                   0, '\n')
+
+/* Maximum length of a format's sentence */
+#define messages_op_length_lit(width)       0
+#define messages_op_length_mark(width)      0
+#define messages_op_length_raw(width)       (width)
+#define messages_op_length_hex(width)       (2 * (width))
+#define messages_op_length_hexr(width)      (2 * (width))
+#define messages_op_length_dec(width)       (width)
+#define messages_op_length_neg(width)       1
+#define messages_op_length_checksum(width)  3
+
+#define messages_field_length(op, src, width, delim)                         \
+                          + messages_op_length_ ## op(width) + ((delim) != 0)
+#define messages_format_length(format)                                       \
+                          (0 format(messages_field_length))
+
+/* Every format's sentences must fit in this (it's also the fixed length of
+ * an sms, see sms.c) */
+#define messages_max_length  messages_format_length(messages_format_a1)
+
+/* One field of a format program; see messages.c */
+typedef struct
+{
+  uint8_t op;
+  uint8_t src;
+  uint8_t width;
+  uint8_t delim;
+} messages_field;
+
+/* A rendered sentence. users counts the readers that haven't finished
+ * with it yet; it is only rendered over once that is back to zero. fresh
+ * is set if it was rendered by the current messages_push */
+typedef struct
+{
+  uint8_t data[messages_max_length];
+  uint8_t length;
+  uint8_t users;
+  uint8_t fresh;
+  const messages_field *format;
+} messages_sentence;
+
+/* Each consumer's format, and its place in the sentence it is sending;
+ * sentence is NULL once it has had the last char */
+typedef struct
+{
+  const messages_field *format;
+  messages_sentence *sentence;
+  uint8_t position;
+} messages_reader;
+
+/* The radio, log and sms each hold at most one sentence, so with three
+ * there is always a free one for messages_push */
+#define messages_sentence_count 3
+
 #define messages_clear_gps_rx_ok()  latest_data.system_state &= ~(0x0F)
 #define messages_set_gps_rx_ok(val)                                 \
                                     latest_data.system_state |= (0x0F & (val))
@@ -80,16 +175,22 @@ typedef struct
 #define messages_set_mcucsr_wdt()   latest_data.system_state |=  (0x80)
 #define messages_clear_mcucsr_wdt() latest_data.system_state &= ~(0x80)
 
-/* Message Buffers; in order of freshness */
-extern payload_message latest_data;  /* Where the next update is built & 
-                                      * kept until ready*/
-extern payload_message    log_data;  /* Logged whenever we get a full update */
-extern payload_message  radio_data;  /* Copied from log data whenever 
-                                      * the radio is ready */
-extern payload_message    sms_data;  /* Sent very rarely */
+/* Where the next update is built & kept until messages_push renders it */
+extern payload_message latest_data;
+
+/* Format programs, in flash */
+extern const messages_field messages_a1[];
+
+/* Readers: the log gets a sentence whenever it is ready for one, the radio
+ * whenever it is idle, and the sms very rarely */
+extern messages_reader  radio_reader;
+extern messages_reader    log_reader;
+extern messages_reader    sms_reader;
 
 /* Prototypes */
-uint8_t messages_get_char(payload_message *data);
+uint8_t messages_get_char(messages_reader *reader);
+uint8_t *messages_peek(messages_reader *reader, uint8_t *length);
+void messages_skip(messages_reader *reader, uint8_t n);
 void messages_push();
 
 #endif 
@@ -68,7 +68,7 @@ void radio_proc()
       /* Defaults to the required mark */
 
       /* Try to get a new char... */
-      radio_char = messages_get_char(&radio_data);
+      radio_char = messages_get_char(&radio_reader);
 
       if (radio_char != 0)
       {
@@ -123,11 +123,11 @@ void radio_init()
   PORTB |= (1 << PB0);
 }
 
-/* This function is called after placing data in radio_data,
- * and signals to the radio that it should start TXing       */
+/* This function is called after giving radio_reader a sentence,
+ * and signals to the radio that it should start TXing         */
 void radio_send()
 {
-  radio_char  = messages_get_char(&radio_data);
+  radio_char  = messages_get_char(&radio_reader);
   radio_state = radio_state_start_bit;
 }
 
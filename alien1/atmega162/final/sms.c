@@ -139,7 +139,7 @@ ISR (USART1_UDRE_vect)
        * we have more than eight. Also, don't go over the max length */
       while (sms_tempbits < 8 && sms_substate != messages_max_length)
       {
-        c = messages_get_char(&sms_data);
+        c = messages_get_char(&sms_reader);
 
         if (c == 0) 
         {
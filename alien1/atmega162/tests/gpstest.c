@@ -88,7 +88,7 @@ ISR (TIMER1_COMPA_vect)
 
     do
     {
-      c = messages_get_char(&radio_data);
+      c = messages_get_char(&radio_reader);
       send_char(c);
     }
     while (c != 0);
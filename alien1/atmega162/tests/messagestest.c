@@ -67,7 +67,7 @@ int main(void)
 
     do
     {
-      c = messages_get_char(&radio_data);
+      c = messages_get_char(&radio_reader);
       send_char(c);
     }
     while (c != 0);
@@ -23,7 +23,7 @@
 
 /* make -sBj5 radiotest.hex.upload */
 
-payload_message radio_data;
+messages_reader radio_reader;
 
 #ifndef TEST_MESSAGE_LONG
   #ifndef TEST_MESSAGE_SHORT
@@ -54,7 +54,7 @@ ISR (TIMER1_COMPA_vect)
   radio_proc();
 }
 
-uint8_t messages_get_char(payload_message *data)
+uint8_t messages_get_char(messages_reader *reader)
 {
   #ifdef TEST_CHAR
   return 'U';   /* 0b01010101 */
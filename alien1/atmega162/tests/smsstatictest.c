@@ -22,13 +22,13 @@
 
 /* Simulate messages.c, timer1.c and timer3.c, test sms.c */
 #include "../final/sms.c"
-payload_message sms_data;
+messages_reader sms_reader;
 
 uint8_t test_message[] = { 'H', 'e', 'l', 'l', 'o', ' ', 
                            'A', 'L', 'I', 'E', 'N', 's' };
 uint8_t test_message_c;
 
-uint8_t messages_get_char(payload_message *data)
+uint8_t messages_get_char(messages_reader *reader)
 {
   uint8_t c;
 
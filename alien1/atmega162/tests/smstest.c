@@ -22,11 +22,11 @@
 
 /* Simulate messages.c, timer1.c and timer3.c, test sms.c */
 #include "../final/sms.c"
-payload_message sms_data;
+messages_reader sms_reader;
 
 volatile uint8_t msg_has_finished;
 
-uint8_t messages_get_char(payload_message *data)
+uint8_t messages_get_char(messages_reader *reader)
 {
   uint8_t c;
 
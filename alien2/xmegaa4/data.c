@@ -0,0 +1,406 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "data.h"
+
+#define CHECKSUM_START  0
+#define CHECKSUM_INNER  1
+#define CHECKSUM_TAIL   2
+
+#define MUX_NONE        0xFF
+
+static uint8_t data_reader_fill(struct data_reader *reader);
+static uint8_t data_mux_ready(const struct data_mux *mux, uint8_t i);
+static uint8_t data_hex(uint8_t n);
+
+uint8_t data_span_byte(const struct data_span *span, uint8_t i)
+{
+    if (span->flags == DATA_SPAN_FLASH)
+    {
+        return pgm_read_byte(&(span->data[i]));
+    }
+    else
+    {
+        return span->data[i];
+    }
+}
+
+void data_reader_start(struct data_reader *reader,
+                       struct data_source *source)
+{
+    reader->source = source;
+    reader->span.len = 0;
+    reader->pos = 0;
+}
+
+uint8_t data_reader_byte(struct data_reader *reader, uint8_t *b)
+{
+    if (reader->pos == reader->span.len &&
+        data_reader_fill(reader) != DATA_SOURCE_OK)
+    {
+        return DATA_SOURCE_FINISHED;
+    }
+
+    *b = data_span_byte(&(reader->span), reader->pos);
+    reader->pos++;
+    return DATA_SOURCE_OK;
+}
+
+uint16_t data_reader_read(struct data_reader *reader, uint8_t *buf,
+                          uint16_t len)
+{
+    uint16_t done;
+    uint8_t n;
+    const uint8_t *p;
+
+    done = 0;
+
+    while (done != len)
+    {
+        if (reader->pos == reader->span.len &&
+            data_reader_fill(reader) != DATA_SOURCE_OK)
+        {
+            break;
+        }
+
+        n = reader->span.len - reader->pos;
+
+        if (n > len - done)
+        {
+            n = len - done;
+        }
+
+        p = reader->span.data + reader->pos;
+
+        if (buf == NULL)
+        {
+            /* Skip */
+        }
+        else if (reader->span.flags == DATA_SPAN_FLASH)
+        {
+            memcpy_P(buf + done, p, n);
+        }
+        else
+        {
+            memcpy(buf + done, p, n);
+        }
+
+        reader->pos += n;
+        done += n;
+    }
+
+    return done;
+}
+
+static uint8_t data_reader_fill(struct data_reader *reader)
+{
+    reader->pos = 0;
+
+    if (reader->source == NULL ||
+        data_next(reader->source, &(reader->span)) != DATA_SOURCE_OK)
+    {
+        reader->span.len = 0;
+        return DATA_SOURCE_FINISHED;
+    }
+
+    return DATA_SOURCE_OK;
+}
+
+uint8_t data_flash_next(struct data_source *source, struct data_span *span)
+{
+    struct data_flash *f;
+    uint16_t n;
+
+    f = (struct data_flash *) source;
+
+    if (f->pos == f->len)
+    {
+        f->pos = 0;
+        return DATA_SOURCE_FINISHED;
+    }
+
+    n = f->len - f->pos;
+
+    if (n > 255)
+    {
+        n = 255;
+    }
+
+    span->data = f->data + f->pos;
+    span->len = n;
+    span->flags = DATA_SPAN_FLASH;
+    f->pos += n;
+    return DATA_SOURCE_OK;
+}
+
+uint8_t data_concat_next(struct data_source *source, struct data_span *span)
+{
+    struct data_concat *c;
+
+    c = (struct data_concat *) source;
+
+    while (c->current != c->count)
+    {
+        if (data_next(c->parts[c->current], span) == DATA_SOURCE_OK)
+        {
+            return DATA_SOURCE_OK;
+        }
+
+        c->current++;
+    }
+
+    c->current = 0;
+    return DATA_SOURCE_FINISHED;
+}
+
+/*
+ * The checksum is worked out as each span goes past, so nothing is
+ * buffered but the text on the end.
+ */
+uint8_t data_checksum_next(struct data_source *source,
+                           struct data_span *span)
+{
+    struct data_checksum *c;
+    uint8_t i, j, b, len;
+
+    c = (struct data_checksum *) source;
+
+    if (c->status == CHECKSUM_START)
+    {
+        c->sum = (c->type == DATA_CHECKSUM_CRC16 ? 0xFFFF : 0);
+        c->count = 0;
+        c->status = CHECKSUM_INNER;
+    }
+
+    if (c->status == CHECKSUM_TAIL)
+    {
+        c->status = CHECKSUM_START;
+        return DATA_SOURCE_FINISHED;
+    }
+
+    if (data_next(c->inner, span) == DATA_SOURCE_OK)
+    {
+        for (i = 0; i < span->len; i++)
+        {
+            if (c->count < c->skip)
+            {
+                c->count++;
+                continue;
+            }
+
+            b = data_span_byte(span, i);
+
+            if (c->type == DATA_CHECKSUM_XOR)
+            {
+                c->sum ^= b;
+                continue;
+            }
+
+            c->sum ^= ((uint16_t) b) << 8;
+
+            for (j = 0; j < 8; j++)
+            {
+                if (c->sum & 0x8000)
+                {
+                    c->sum = (c->sum << 1) ^ 0x1021;
+                }
+                else
+                {
+                    c->sum <<= 1;
+                }
+            }
+        }
+
+        return DATA_SOURCE_OK;
+    }
+
+    len = (c->type == DATA_CHECKSUM_XOR ? 2 : 4);
+    c->text[0] = '*';
+
+    for (i = 0; i < len; i++)
+    {
+        c->text[len - i] = data_hex((c->sum >> (i * 4)) & 0x0F);
+    }
+
+    c->text[len + 1] = '\n';
+
+    span->data = c->text;
+    span->len = len + 2;
+    span->flags = DATA_SPAN_RAM;
+    c->status = CHECKSUM_TAIL;
+    return DATA_SOURCE_OK;
+}
+
+/*
+ * empty is set until inner gives a span in this pass, so that an empty
+ * inner source can't loop forever.
+ */
+uint8_t data_repeat_next(struct data_source *source, struct data_span *span)
+{
+    struct data_repeat *r;
+
+    r = (struct data_repeat *) source;
+
+    for (;;)
+    {
+        if (data_next(r->inner, span) == DATA_SOURCE_OK)
+        {
+            r->empty = 0;
+            return DATA_SOURCE_OK;
+        }
+
+        r->done++;
+
+        if (r->empty || (r->times != 0 && r->done == r->times))
+        {
+            r->done = 0;
+            r->empty = 1;
+            return DATA_SOURCE_FINISHED;
+        }
+
+        r->empty = 1;
+    }
+}
+
+uint8_t data_mux_next(struct data_source *source, struct data_span *span)
+{
+    struct data_mux *m;
+    uint8_t i;
+
+    m = (struct data_mux *) source;
+
+    for (;;)
+    {
+        if (m->current == MUX_NONE)
+        {
+            if (m->limit == 0 || m->sent != m->limit)
+            {
+                for (i = 0; i < m->count; i++)
+                {
+                    if (data_mux_ready(m, i))
+                    {
+                        m->current = i;
+                        break;
+                    }
+                }
+            }
+
+            if (m->current == MUX_NONE)
+            {
+                break;
+            }
+
+            m->sent++;
+            m->once |= (1 << m->current);
+            m->empty = 1;
+        }
+
+        if (data_next(m->inputs[m->current].source, span) == DATA_SOURCE_OK)
+        {
+            m->empty = 0;
+            return DATA_SOURCE_OK;
+        }
+
+        m->current = MUX_NONE;
+
+        if (m->empty)
+        {
+            break;
+        }
+    }
+
+    m->sent = 0;
+    m->once = 0;
+    return DATA_SOURCE_FINISHED;
+}
+
+uint16_t data_mux_length(const struct data_mux *mux)
+{
+    const struct data_mux_input *input;
+    uint16_t len;
+    uint8_t i, n, left;
+
+    len = 0;
+    left = mux->limit;
+
+    for (i = 0; i < mux->count; i++)
+    {
+        input = &(mux->inputs[i]);
+
+        if (!data_mux_ready(mux, i))
+        {
+            continue;
+        }
+
+        if (mux->limit == 0 || (input->flags & DATA_MUX_ONCE))
+        {
+            n = 1;
+        }
+        else
+        {
+            n = left;
+        }
+
+        if (input->length != NULL)
+        {
+            len += input->length() * n;
+        }
+
+        if (mux->limit != 0)
+        {
+            left -= n;
+
+            if (left == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    return len;
+}
+
+static uint8_t data_mux_ready(const struct data_mux *mux, uint8_t i)
+{
+    const struct data_mux_input *input;
+
+    input = &(mux->inputs[i]);
+
+    if ((input->flags & DATA_MUX_ONCE) && (mux->once & (1 << i)))
+    {
+        return 0;
+    }
+
+    return (input->ready == NULL || input->ready());
+}
+
+static uint8_t data_hex(uint8_t n)
+{
+    if (n < 10)
+    {
+        return '0' + n;
+    }
+    else
+    {
+        return 'A' - 10 + n;
+    }
+}
@@ -11,7 +11,7 @@
     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
     GNU General Public License for more details.
 
-    For a full copy of the GNU General Public License, 
+    For a full copy of the GNU General Public License,
     see <http://www.gnu.org/licenses/>.
 */
 
@@ -23,10 +23,167 @@
 #define DATA_SOURCE_OK       0
 #define DATA_SOURCE_FINISHED 1
 
+#define DATA_SPAN_RAM        0
+#define DATA_SPAN_FLASH      1
+
+/*
+ * A run of len (at least 1) bytes, in RAM or, if flags is
+ * DATA_SPAN_FLASH, in program memory (see data_span_byte). It is only
+ * valid until the next call to the source it came from.
+ */
+struct data_span
+{
+    const uint8_t *data;
+    uint8_t len;
+    uint8_t flags;
+};
+
+/*
+ * next writes the source's next span to span and returns DATA_SOURCE_OK,
+ * or returns DATA_SOURCE_FINISHED at the end of the stream. The call after
+ * that starts the stream again (or a new one).
+ *
+ * A source with state of its own is a struct that starts with a
+ * struct data_source, which is what next is given; see the adapters below.
+ */
+struct data_source;
+typedef uint8_t (*data_next_function)(struct data_source *source,
+                                      struct data_span *span);
+
+struct data_source
+{
+    data_next_function next;
+};
+
+#define data_next(source, span) ((source)->next((source), (span)))
+
+uint8_t data_span_byte(const struct data_span *span, uint8_t i);
+
+/*
+ * For modes that want a byte (or a block) at a time: the source is only
+ * called when the span in hand runs out. A NULL source is empty.
+ * data_reader_read copies up to len bytes to buf (or skips them, if buf
+ * is NULL) and returns how many there were; fewer than len means the
+ * stream finished.
+ */
+struct data_reader
+{
+    struct data_source *source;
+    struct data_span span;
+    uint8_t pos;
+};
+
+void data_reader_start(struct data_reader *reader,
+                       struct data_source *source);
+uint8_t data_reader_byte(struct data_reader *reader, uint8_t *b);
+uint16_t data_reader_read(struct data_reader *reader, uint8_t *buf,
+                          uint16_t len);
+
 /*
- * writes a new byte to b and returns 0, or 
- * returns 1 to indicate the end of the stream
+ * Adapters. Each is declared as, e.g.,
+ *
+ *   struct data_flash test_source = DATA_FLASH(test_string, len);
+ *
+ * and used as &test_source.source.
  */
-typedef uint8_t (*data_source)(uint8_t *b);
+
+/* len bytes of program memory, in spans of up to 255 */
+struct data_flash
+{
+    struct data_source source;
+    const uint8_t *data;
+    uint16_t len, pos;
+};
+
+#define DATA_FLASH(data, len)  { { data_flash_next }, (data), (len), 0 }
+uint8_t data_flash_next(struct data_source *source, struct data_span *span);
+
+/* Each of count parts in turn */
+struct data_concat
+{
+    struct data_source source;
+    struct data_source *const *parts;
+    uint8_t count, current;
+};
+
+#define DATA_CONCAT(parts, count)  \
+    { { data_concat_next }, (parts), (count), 0 }
+uint8_t data_concat_next(struct data_source *source, struct data_span *span);
+
+/*
+ * inner, then "*", the checksum of all but the first skip bytes of it in
+ * hex, and "\n". DATA_CHECKSUM_XOR is NMEA's (2 digits) and
+ * DATA_CHECKSUM_CRC16 the UKHAS CRC16-CCITT (4 digits).
+ */
+#define DATA_CHECKSUM_XOR    0
+#define DATA_CHECKSUM_CRC16  1
+
+struct data_checksum
+{
+    struct data_source source;
+    struct data_source *inner;
+    uint8_t type, skip;
+    uint8_t status, count;
+    uint16_t sum;
+    uint8_t text[7];
+};
+
+#define DATA_CHECKSUM(inner, type, skip)  \
+    { { data_checksum_next }, (inner), (type), (skip), 0, 0, 0, { 0 } }
+uint8_t data_checksum_next(struct data_source *source,
+                           struct data_span *span);
+
+/* inner, times times over; or forever if times is 0 */
+struct data_repeat
+{
+    struct data_source source;
+    struct data_source *inner;
+    uint8_t times, done, empty;
+};
+
+#define DATA_REPEAT(inner, times)  \
+    { { data_repeat_next }, (inner), (times), 0, 1 }
+uint8_t data_repeat_next(struct data_source *source, struct data_span *span);
+
+/*
+ * Whole packets from several inputs as one stream, where a packet is
+ * everything an input gives up to it finishing. At each packet boundary
+ * the first input (in order) that is ready sends its next packet, so
+ * earlier inputs jump ahead of later ones, though never in the middle of
+ * a packet. ready is NULL for an input that always is. A DATA_MUX_ONCE
+ * input sends at most one packet per stream: e.g., a fresh position
+ * report goes ahead of any image packets, but only once.
+ *
+ * The stream finishes when no input is ready, or after limit packets (0
+ * for no limit); and if a ready input turns out to have nothing, rather
+ * than spinning. ready is called from wherever the mux is (usually an
+ * ISR). There can be at most 8 inputs.
+ *
+ * data_mux_length estimates the length of the stream, for the scheduler,
+ * from the inputs that are ready now; without a limit, it counts one
+ * packet from each.
+ */
+#define DATA_MUX_ONCE  0x01
+
+struct data_mux_input
+{
+    struct data_source *source;
+    uint8_t (*ready)();
+    uint16_t (*length)();
+    uint8_t flags;
+};
+
+struct data_mux
+{
+    struct data_source source;
+    const struct data_mux_input *inputs;
+    uint8_t count, limit;
+    uint8_t current, sent, once, empty;
+};
+
+#define DATA_MUX(inputs, count, limit)  \
+    { { data_mux_next }, (inputs), (count), (limit), 0xFF, 0, 0, 0 }
+uint8_t data_mux_next(struct data_source *source, struct data_span *span);
+uint16_t data_mux_length(const struct data_mux *mux);
 
 #endif
@@ -16,9 +16,11 @@
 */
 
 #include <stdint.h>
+#include <string.h>
 
 #include "usart.h"
 #include "debug.h"
+#include "trace.h"
 
 #if DEBUG
 
@@ -27,15 +29,40 @@ static uint8_t debug_boot_message[] = "This is ALIEN-2\nDebug USART Ready\n\n";
 void debug_init()
 {
     usart_init();
-    debug_write(debug_boot_message, sizeof(debug_boot_message));
+    debug_write(debug_boot_message, sizeof(debug_boot_message) - 1);
 }
 
 uint8_t debug_write(uint8_t *data, uint16_t len)
 {
-    uint8_t status;
-    status = buffer_write(data, len);
-    usart_tx_enable();
-    return status;
+    uint8_t *payload;
+    uint8_t chunk;
+
+    while (len != 0)
+    {
+        if (len > TRACE_MAX_LEN)
+        {
+            chunk = TRACE_MAX_LEN;
+        }
+        else
+        {
+            chunk = len;
+        }
+
+        payload = trace_reserve(TRACE_TEXT, chunk);
+
+        if (payload == NULL)
+        {
+            return DEBUG_OVERFLOW;
+        }
+
+        memcpy(payload, data, chunk);
+        trace_commit(payload);
+
+        data += chunk;
+        len -= chunk;
+    }
+
+    return DEBUG_OK;
 }
 
 #endif
@@ -25,11 +25,11 @@
 #if DEBUG
 
 #include <stdint.h>
-#include "buffer.h"
 
-#define DEBUG_OK       BUFFER_OK
-#define DEBUG_OVERFLOW BUFFER_OVERFLOW
+#define DEBUG_OK       0
+#define DEBUG_OVERFLOW 1
 
+/* Text; it's sent as TRACE_TEXT records (see trace.h) */
 void debug_init();
 uint8_t debug_write(uint8_t *data, uint16_t len);
 
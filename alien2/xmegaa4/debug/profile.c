@@ -0,0 +1,265 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "../radio/radio.h"
+#include "profile.h"
+#include "trace.h"
+
+#if PROFILE
+
+/*
+ * TCC1 free runs at F_CPU, so times are in cycles. It wraps every 65536
+ * cycles (8.2ms), which is the longest ISR we can measure. The ISR
+ * prologue and epilogue (register saves) aren't included.
+ *
+ * Each radio mode (and options) gets a slot, as do the radio delays and
+ * the debug USART. A low level ISR can be interrupted by a high level one;
+ * profile_hi_total lets us take that time back out.
+ *
+ * Histogram bucket 0 is < 128 cycles, bucket n (1 to 6) is 2^(n + 6) to
+ * 2^(n + 7) - 1 cycles, and bucket 7 is 8192 or more.
+ *
+ * Every PROFILE_PERIOD seconds, each slot that has been used is sent as
+ * a TRACE_PROFILE record covering only that period:
+ *
+ *   <count: 4> <total: 4> <min: 2> <max: 2> <bucket: 2> * PROFILE_BUCKETS
+ *   <short name>
+ */
+#define PROFILE_TIMER       TCC1
+#define PROFILE_PERIOD      10
+#define PROFILE_BUCKETS     8
+#define PROFILE_SLOTS       10
+#define PROFILE_SLOT_USART  0
+#define PROFILE_SLOT_DELAY  1
+#define PROFILE_SLOT_MODES  2
+#define PROFILE_RECORD_LEN  (12 + (2 * PROFILE_BUCKETS))
+
+struct profile_slot
+{
+    const struct radio_mode *mode;
+    uint8_t options;
+    uint32_t count, total;
+    uint16_t min, max;
+    uint16_t buckets[PROFILE_BUCKETS];
+};
+
+static struct profile_slot profile_slots[PROFILE_SLOTS];
+static struct profile_slot *profile_last_slot;
+static uint16_t profile_hi_start, profile_hi_total;
+static uint16_t profile_lo_start, profile_lo_hi_total;
+static uint8_t profile_seconds;
+
+static char profile_usart_name[] PROGMEM = "USART";
+static char profile_delay_name[] PROGMEM = "delay";
+
+static struct profile_slot *profile_radio_slot();
+static void profile_add(struct profile_slot *slot, uint16_t cycles);
+static void profile_report();
+
+void profile_init()
+{
+    PROFILE_TIMER.PER = 0xFFFF;
+    PROFILE_TIMER.CTRLA = TC_CLKSEL_DIV1_gc;
+    profile_last_slot = &profile_slots[PROFILE_SLOT_DELAY];
+}
+
+/* High level ISRs can't be interrupted, so can read CNT directly */
+void profile_hi_begin()
+{
+    profile_hi_start = PROFILE_TIMER.CNT;
+}
+
+void profile_hi_end()
+{
+    uint16_t cycles;
+
+    cycles = PROFILE_TIMER.CNT - profile_hi_start;
+    profile_hi_total += cycles;
+    profile_add(profile_radio_slot(), cycles);
+}
+
+void profile_lo_begin()
+{
+    uint8_t sreg;
+
+    sreg = SREG;
+    cli();
+    profile_lo_start = PROFILE_TIMER.CNT;
+    profile_lo_hi_total = profile_hi_total;
+    SREG = sreg;
+}
+
+void profile_lo_end()
+{
+    uint16_t cycles;
+    uint8_t sreg;
+
+    sreg = SREG;
+    cli();
+    cycles = (PROFILE_TIMER.CNT - profile_lo_start) -
+             (profile_hi_total - profile_lo_hi_total);
+    profile_add(&profile_slots[PROFILE_SLOT_USART], cycles);
+    SREG = sreg;
+}
+
+/* Called once a second, from outside of any ISR */
+void profile_tick()
+{
+    profile_seconds++;
+
+    if (profile_seconds >= PROFILE_PERIOD)
+    {
+        profile_seconds = 0;
+        profile_report();
+    }
+}
+
+static struct profile_slot *profile_radio_slot()
+{
+    struct profile_slot *slot;
+    uint8_t i;
+
+    if (radio_current_state == NULL)
+    {
+        return &profile_slots[PROFILE_SLOT_DELAY];
+    }
+
+    slot = profile_last_slot;
+
+    if (slot->mode == radio_current_state->mode &&
+        slot->options == radio_current_state->options)
+    {
+        return slot;
+    }
+
+    for (i = PROFILE_SLOT_MODES; i < PROFILE_SLOTS; i++)
+    {
+        slot = &profile_slots[i];
+
+        if (slot->mode == NULL)
+        {
+            slot->mode = radio_current_state->mode;
+            slot->options = radio_current_state->options;
+        }
+
+        if (slot->mode == radio_current_state->mode &&
+            slot->options == radio_current_state->options)
+        {
+            profile_last_slot = slot;
+            return slot;
+        }
+    }
+
+    /* Out of slots */
+    return &profile_slots[PROFILE_SLOT_DELAY];
+}
+
+static void profile_add(struct profile_slot *slot, uint16_t cycles)
+{
+    uint16_t limit;
+    uint8_t bucket;
+
+    if (slot->count == 0 || cycles < slot->min)
+    {
+        slot->min = cycles;
+    }
+
+    if (cycles > slot->max)
+    {
+        slot->max = cycles;
+    }
+
+    slot->count++;
+    slot->total += cycles;
+
+    bucket = 0;
+    limit = 128;
+
+    while (bucket < PROFILE_BUCKETS - 1 && cycles >= limit)
+    {
+        bucket++;
+        limit <<= 1;
+    }
+
+    slot->buckets[bucket]++;
+}
+
+static void profile_report()
+{
+    struct profile_slot slot;
+    PGM_P name;
+    uint8_t *p;
+    uint8_t i, j, name_len;
+
+    for (i = 0; i < PROFILE_SLOTS; i++)
+    {
+        /* Take a copy and start the next period */
+        cli();
+        memcpy(&slot, &profile_slots[i], sizeof(slot));
+        memset(&profile_slots[i].count, 0,
+               sizeof(slot) - offsetof(struct profile_slot, count));
+        sei();
+
+        if (slot.count == 0)
+        {
+            continue;
+        }
+
+        if (i == PROFILE_SLOT_USART)
+        {
+            name = profile_usart_name;
+        }
+        else if (i == PROFILE_SLOT_DELAY)
+        {
+            name = profile_delay_name;
+        }
+        else
+        {
+            name = slot.mode->getname(RADIO_NAME_SHORT, slot.options);
+        }
+
+        name_len = strlen_P(name);
+        p = trace_reserve(TRACE_PROFILE, PROFILE_RECORD_LEN + name_len);
+
+        if (p == NULL)
+        {
+            return;
+        }
+
+        p = trace_put_uint(p, slot.count, 4);
+        p = trace_put_uint(p, slot.total, 4);
+        p = trace_put_uint(p, slot.min, 2);
+        p = trace_put_uint(p, slot.max, 2);
+
+        for (j = 0; j < PROFILE_BUCKETS; j++)
+        {
+            p = trace_put_uint(p, slot.buckets[j], 2);
+        }
+
+        memcpy_P(p, name, name_len);
+        trace_commit(p - PROFILE_RECORD_LEN);
+    }
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DEBUG_PROFILE_H__
+#define __DEBUG_PROFILE_H__
+
+#include <stdint.h>
+#include "debug.h"
+
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+#if PROFILE && !DEBUG
+#error "PROFILE reports over debug, so it needs DEBUG"
+#endif
+
+/*
+ * ISR cycle profiler (make DEBUG=1 PROFILE=1). The radio ISRs (high level)
+ * call profile_hi_begin/end around radio_isr, and the debug USART ISR
+ * (low level) calls profile_lo_begin/end. Every PROFILE_PERIOD seconds
+ * profile_tick sends a report; see profile.c.
+ */
+#if PROFILE
+
+void profile_init();
+void profile_hi_begin();
+void profile_hi_end();
+void profile_lo_begin();
+void profile_lo_end();
+void profile_tick();
+
+#else
+
+#define profile_init()
+#define profile_hi_begin()
+#define profile_hi_end()
+#define profile_lo_begin()
+#define profile_lo_end()
+#define profile_tick()
+
+#endif
+
+#endif
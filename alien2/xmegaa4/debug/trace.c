@@ -0,0 +1,198 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "../radio/hardware.h"
+#include "debug.h"
+#include "trace.h"
+#include "usart.h"
+
+#if DEBUG
+
+/*
+ * A power of two ring. Indices are free running; only their low bits
+ * index the ring. trace_reserved is the end of the last reservation,
+ * trace_head the end of the committed records, which the transmitter
+ * (the one consumer) sends up to, advancing trace_tail.
+ *
+ * Producers can be in main and in ISRs of any level, so taking space
+ * (bumping trace_reserved) is done with interrupts off; it's a handful
+ * of instructions. The record itself is written after that, in place.
+ * Records are never split across the end of the ring: if one doesn't fit
+ * before the end, the rest of the ring is padded with zeroes.
+ */
+#define TRACE_SIZE 512
+#define TRACE_MASK (TRACE_SIZE - 1)
+
+static uint8_t trace_ring[TRACE_SIZE];
+static uint16_t trace_reserved, trace_head, trace_tail;
+static uint8_t trace_nesting;
+static uint16_t trace_seq, trace_overflows, trace_overflows_sent;
+
+uint8_t *trace_reserve(uint8_t type, uint8_t len)
+{
+    uint8_t *record;
+    uint16_t total, pos, skip, seq;
+    uint32_t time;
+    uint8_t sreg;
+
+    total = TRACE_HEADER_LEN + len + 1;
+
+    sreg = SREG;
+    cli();
+
+    seq = trace_seq;
+    trace_seq++;
+
+    /* The radio ISRs add to the tick count a byte at a time */
+    time = radio_hw_ticks();
+
+    pos = trace_reserved & TRACE_MASK;
+    skip = 0;
+
+    if (pos + total > TRACE_SIZE)
+    {
+        skip = TRACE_SIZE - pos;
+    }
+
+    if ((uint16_t) (trace_reserved - trace_tail) + skip + total > TRACE_SIZE)
+    {
+        trace_overflows++;
+        SREG = sreg;
+        return NULL;
+    }
+
+    memset(&trace_ring[pos], 0, skip);
+    record = &trace_ring[(trace_reserved + skip) & TRACE_MASK];
+    trace_reserved += skip + total;
+    trace_nesting++;
+
+    SREG = sreg;
+
+    record[0] = TRACE_SYNC;
+    record[1] = type;
+    record[2] = len;
+    record[3] = seq & 0xFF;
+    record[4] = seq >> 8;
+    record[5] = time & 0xFF;
+    record[6] = (time >> 8) & 0xFF;
+    record[7] = (time >> 16) & 0xFF;
+    record[8] = time >> 24;
+
+    return record + TRACE_HEADER_LEN;
+}
+
+void trace_commit(uint8_t *payload)
+{
+    uint8_t *record, *p;
+    uint8_t checksum, i, len, sreg, overflowed;
+
+    record = payload - TRACE_HEADER_LEN;
+    len = record[2];
+    checksum = 0;
+
+    for (p = record + 1, i = 0; i < TRACE_HEADER_LEN - 1 + len; i++, p++)
+    {
+        checksum ^= *p;
+    }
+
+    *p = checksum;
+
+    sreg = SREG;
+    cli();
+
+    trace_nesting--;
+    overflowed = 0;
+
+    if (trace_nesting == 0)
+    {
+        trace_head = trace_reserved;
+        usart_tx_enable();
+
+        overflowed = (trace_overflows != trace_overflows_sent);
+        trace_overflows_sent = trace_overflows;
+    }
+
+    SREG = sreg;
+
+    if (overflowed)
+    {
+        payload = trace_reserve(TRACE_OVERFLOW, 2);
+
+        /* If there's no room, this is counted and we'll try again */
+        if (payload != NULL)
+        {
+            payload[0] = trace_overflows_sent & 0xFF;
+            payload[1] = trace_overflows_sent >> 8;
+            trace_commit(payload);
+        }
+    }
+}
+
+void trace_write(uint8_t type, uint8_t *data, uint8_t len)
+{
+    uint8_t *payload;
+
+    payload = trace_reserve(type, len);
+
+    if (payload != NULL)
+    {
+        memcpy(payload, data, len);
+        trace_commit(payload);
+    }
+}
+
+uint8_t *trace_put_uint(uint8_t *p, uint32_t value, uint8_t len)
+{
+    while (len != 0)
+    {
+        *p = value & 0xFF;
+        value >>= 8;
+        p++;
+        len--;
+    }
+
+    return p;
+}
+
+uint16_t trace_read_span(uint8_t **data)
+{
+    uint16_t len, pos;
+
+    pos = trace_tail & TRACE_MASK;
+    *data = &trace_ring[pos];
+    len = TRACE_SIZE - pos;
+
+    if (len > (uint16_t) (trace_head - trace_tail))
+    {
+        len = trace_head - trace_tail;
+    }
+
+    return len;
+}
+
+void trace_consume(uint16_t len)
+{
+    trace_tail += len;
+}
+
+#endif
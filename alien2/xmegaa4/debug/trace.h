@@ -0,0 +1,80 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DEBUG_TRACE_H__
+#define __DEBUG_TRACE_H__
+
+#include <stdint.h>
+#include "debug.h"
+
+/*
+ * Everything sent over debug is a trace record:
+ *
+ *   TRACE_SYNC <type: 1> <len: 1> <seq: 2> <time: 4> <payload: len>
+ *   <xor of everything from type to the end of the payload: 1>
+ *
+ * Values are little endian. seq counts every record that was attempted,
+ * so a gap means records were dropped; the next one that fits after that
+ * is a TRACE_OVERFLOW. time is radio_hw_ticks(). Bytes between records
+ * (anything but TRACE_SYNC) are padding, and should be skipped.
+ *
+ * misc-c/pc/tracedump.c decodes the stream.
+ */
+#define TRACE_SYNC         0xA5
+#define TRACE_HEADER_LEN   9
+#define TRACE_MAX_LEN      255
+
+#define TRACE_TEXT         0x01  /* debug_write */
+#define TRACE_OVERFLOW     0x02  /* <records dropped so far: 2> */
+#define TRACE_RADIO_STATS  0x03  /* see radio_stats in radio/radio.c */
+#define TRACE_PROFILE      0x04  /* see debug/profile.c */
+#define TRACE_UPLINK       0x05  /* a decoded uplink frame */
+#define TRACE_LINK         0x06  /* see uplink_link_update in radio/uplink.c */
+
+#if DEBUG
+
+/*
+ * trace_reserve returns somewhere to write len bytes of payload in place,
+ * or NULL if there isn't room (the record is dropped and counted). Each
+ * reserve must be followed by a trace_commit of what it returned.
+ * Records can be reserved from main and from ISRs at any level: an ISR
+ * that interrupts someone between their reserve and commit must commit its
+ * own records before returning (ISRs don't hang on to reservations), and
+ * none are sent until the outermost one is committed.
+ */
+uint8_t *trace_reserve(uint8_t type, uint8_t len);
+void trace_commit(uint8_t *payload);
+void trace_write(uint8_t type, uint8_t *data, uint8_t len);
+
+/* Writes value as len little endian bytes at p; returns p + len */
+uint8_t *trace_put_uint(uint8_t *p, uint32_t value, uint8_t len);
+
+/*
+ * For the transmitter: committed bytes, as far as they're contiguous in
+ * memory, and the same again once they're sent. Call with interrupts
+ * disabled.
+ */
+uint16_t trace_read_span(uint8_t **data);
+void trace_consume(uint16_t len);
+
+#else
+
+#define trace_write(type, data, len)
+
+#endif
+
+#endif
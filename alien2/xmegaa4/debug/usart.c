@@ -20,48 +20,100 @@
 #include <avr/interrupt.h>
 
 #include "../data.h"
-#include "buffer.h"
+#include "trace.h"
 #include "usart.h"
+#include "profile.h"
 
 #if DEBUG
 
-static uint8_t usart_idle;
+/*
+ * The trace ring is sent by DMA, a contiguous span of it at a time, so
+ * there's one (low level) interrupt per span rather than one per byte. Each
+ * DMA burst is one byte, triggered whenever the USART's DATA is empty. The
+ * radio uses DMA CH0 and CH1.
+ */
+#define USART_DMA_CH    DMA.CH2
+#define USART_DMA_TRIG  DMA_CH_TRIGSRC_USARTD1_DRE_gc
+
+#ifndef DEBUG_BAUD
+#define DEBUG_BAUD 1000000
+#endif
+
+/*
+ * F_CPU = 8MHz. With CLK2X, BSEL 0 and BSCALE 0, we get F_CPU / 8, which
+ * is as fast as the USART goes.
+ */
+#if DEBUG_BAUD == 1000000
+#define USART_BAUDCTRLA 0
+#define USART_BAUDCTRLB 0
+#define USART_CLK2X     USART_CLK2X_bm
+#elif DEBUG_BAUD == 500000
+#define USART_BAUDCTRLA 0
+#define USART_BAUDCTRLB 0
+#define USART_CLK2X     0
+#elif DEBUG_BAUD == 115200
+/* BSCALE: -6, BSEL: 214 */
+#define USART_BAUDCTRLA 214
+#define USART_BAUDCTRLB 160
+#define USART_CLK2X     0
+#elif DEBUG_BAUD == 9600
+/* BSCALE: -6, BSEL: 3269 */
+#define USART_BAUDCTRLA 197
+#define USART_BAUDCTRLB 172
+#define USART_CLK2X     0
+#else
+#error "Unsupported DEBUG_BAUD"
+#endif
+
+static void usart_tx_span();
 
-ISR(USARTD1_DRE_vect)
+/* Length of the span being sent; 0 if idle */
+static uint16_t usart_span;
+
+ISR(DMA_CH2_vect)
 {
-    uint8_t b, status;
-    status = buffer_read_byte(&b);
+    uint8_t sreg;
 
-    if (status == DATA_SOURCE_OK)
-    {
-        USARTD1.DATA = b;
-    }
-    else
-    {
-        usart_tx_disable();
-    }
+    profile_lo_begin();
+
+    /* Records may be committed from a high level ISR */
+    sreg = SREG;
+    cli();
+
+    USART_DMA_CH.CTRLB |= DMA_CH_TRNIF_bm;
+    trace_consume(usart_span);
+    usart_tx_span();
+
+    SREG = sreg;
+
+    profile_lo_end();
 }
 
+/* Called by trace_commit, with interrupts disabled */
 void usart_tx_enable()
 {
-    if (usart_idle == 0)
+    if (usart_span == 0)
     {
-        return;
+        usart_tx_span();
     }
-
-    USARTD1.CTRLA = USART_DREINTLVL_LO_gc;
-    usart_idle = 0;
 }
 
-void usart_tx_disable()
+static void usart_tx_span()
 {
-    if (usart_idle == 1)
+    uint8_t *data;
+
+    usart_span = trace_read_span(&data);
+
+    if (usart_span == 0)
     {
         return;
     }
 
-    USARTD1.CTRLA = 0;
-    usart_idle = 1;
+    USART_DMA_CH.SRCADDR0 = ((uint16_t) data) & 0xFF;
+    USART_DMA_CH.SRCADDR1 = ((uint16_t) data) >> 8;
+    USART_DMA_CH.TRFCNT = usart_span;
+    USART_DMA_CH.CTRLA = DMA_CH_ENABLE_bm | DMA_CH_SINGLE_bm |
+                         DMA_CH_BURSTLEN_1BYTE_gc;
 }
 
 void usart_init()
@@ -69,19 +121,23 @@ void usart_init()
     PORTD.DIRSET = 0x80;
 
     USARTD1.CTRLC = USART_CHSIZE_8BIT_gc;
-    USARTD1.CTRLB = USART_TXEN_bm;
-
-    /*
-     * 9600 baud, BSCALE: -6, BSEL: 3269 
-     * USARTD1.BAUDCTRLA = 197;
-     * USARTD1.BAUDCTRLB = 172;
-     */
-
-    /* 115200 baud, BSCALE: -6, BSEL: 214 */
-    USARTD1.BAUDCTRLA = 214;
-    USARTD1.BAUDCTRLB = 160;
-
-    usart_idle = 1;
+    USARTD1.CTRLB = USART_TXEN_bm | USART_CLK2X;
+    USARTD1.BAUDCTRLA = USART_BAUDCTRLA;
+    USARTD1.BAUDCTRLB = USART_BAUDCTRLB;
+
+    /* radio_hw_init will enable the DMA controller too; that's fine */
+    DMA.CTRL |= DMA_ENABLE_bm;
+
+    USART_DMA_CH.CTRLA = 0;
+    USART_DMA_CH.CTRLB = DMA_CH_TRNINTLVL_LO_gc;
+    USART_DMA_CH.ADDRCTRL = DMA_CH_SRCDIR_INC_gc | DMA_CH_DESTDIR_FIXED_gc;
+    USART_DMA_CH.TRIGSRC = USART_DMA_TRIG;
+    USART_DMA_CH.SRCADDR2 = 0;
+    USART_DMA_CH.DESTADDR0 = ((uint16_t) &(USARTD1.DATA)) & 0xFF;
+    USART_DMA_CH.DESTADDR1 = ((uint16_t) &(USARTD1.DATA)) >> 8;
+    USART_DMA_CH.DESTADDR2 = 0;
+
+    usart_span = 0;
 }
 
 #endif
@@ -24,7 +24,6 @@
 #if DEBUG
 
 void usart_tx_enable();
-void usart_tx_disable();
 void usart_init();
 
 #endif
@@ -20,18 +20,30 @@
 
 #include "radio/radio.h"
 #include "debug/debug.h"
+#include "debug/profile.h"
+#include "telem/monitor.h"
+#include "telem/telem.h"
+#include "ssdv/ssdv.h"
+#include "test.h"
 
 static void clock_init();
+static void rtc_init();
 static void interrupt_enable();
-static void sleep_forever();
+static void main_loop();
+
+static volatile uint8_t rtc_ticked;
 
 int main()
 {
     clock_init();
+    rtc_init();
     debug_init();
+    profile_init();
+    telem_init();
+    ssdv_init(&test_jpeg_source.source);
     radio_init();
     interrupt_enable();
-    sleep_forever();
+    main_loop();
 
     return 0;
 }
@@ -55,13 +67,51 @@ static void clock_init()
     OSC.CTRL = OSC_XOSCEN_bm;
 }
 
+static void rtc_init()
+{
+    /* 1.024kHz from the internal 32kHz ULP oscillator */
+    CLK.RTCCTRL = CLK_RTCSRC_ULP_gc | CLK_RTCEN_bm;
+
+    while (RTC.STATUS & RTC_SYNCBUSY_bm);
+
+    /* Overflow once a second */
+    RTC.PER = 1023;
+    RTC.CNT = 0;
+    RTC.INTCTRL = RTC_OVFINTLVL_LO_gc;
+    RTC.CTRL = RTC_PRESCALER_DIV1_gc;
+}
+
+ISR(RTC_OVF_vect)
+{
+    rtc_ticked = 1;
+}
+
 static void interrupt_enable()
 {
     PMIC.CTRL = PMIC_HILVLEN_bm | PMIC_MEDLVLEN_bm | PMIC_LOLVLEN_bm;
     sei();
 }
 
-static void sleep_forever()
+/*
+ * Slow work (e.g., rendering telemetry, encoding symbols or SSDV packets) is
+ * done here, where the radio can interrupt it. Every radio interrupt wakes us,
+ * so the radio's buffers are topped up after each one. If a tick arrives just
+ * before sleep_mode, the radio's timer will wake us again very shortly.
+ */
+static void main_loop()
 {
-    for (;;) sleep_mode();
+    for (;;)
+    {
+        sleep_mode();
+        radio_refill();
+        ssdv_update();
+
+        if (rtc_ticked)
+        {
+            rtc_ticked = 0;
+            monitor_update();
+            telem_update();
+            profile_tick();
+        }
+    }
 }
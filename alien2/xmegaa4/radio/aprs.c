@@ -0,0 +1,438 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "radio.h"
+#include "hardware.h"
+#include "aprs.h"
+
+static void aprs_init();
+static uint8_t aprs_interrupt();
+static PGM_P aprs_getname(uint8_t t, uint8_t options);
+static uint32_t aprs_airtime(uint8_t options, uint16_t len);
+static uint8_t aprs_encode(uint16_t *b);
+static uint8_t aprs_next_bit();
+static uint8_t aprs_next_byte();
+static void aprs_flag();
+static void aprs_data(uint8_t c);
+static uint8_t aprs_header_byte(uint8_t i);
+
+const struct radio_mode aprs = { aprs_init, aprs_interrupt, aprs_getname,
+                                 aprs_airtime, NULL };
+
+/*
+ * Bell 202 AFSK (1200 baud; 1200Hz and 2200Hz tones) carrying an AX.25 UI
+ * frame, with the current source as its information field. Unlike the
+ * other modes, the DAC sends audio: it is the modulating signal of an FM
+ * transmission (which is what APRS receivers expect) rather than a shift
+ * of the carrier.
+ *
+ * The tones come from a phase accumulator, so the phase carries on
+ * unbroken across a change of tone: each sample adds a tone's increment
+ * to aprs_phase, and the top six bits of it look up aprs_sine. Samples
+ * are clocked out by DMA (see radio_hw_dma_start), APRS_SAMPLES_PER_BIT
+ * to a bit, and aprs_interrupt is called once per
+ * RADIO_HW_DMA_BUFFER_LEN of them to fill the next buffer. A sample is
+ * 833 CPU cycles, so bits are 400ppm fast, which is well within what a
+ * receiver will track.
+ *
+ * The frame is APRS_PREAMBLE flags, the header (see aprs_header_byte), the
+ * information field (at most APRS_MAX_INFO bytes), the FCS and then
+ * APRS_TAIL flags. Bytes go LSB first, with a 0 stuffed in after any five
+ * 1s in a row outside of the flags, and are NRZI encoded: a 0 is a change
+ * of tone, and a 1 is no change.
+ */
+#define APRS_SAMPLE_PER       832
+#define APRS_SAMPLE_CYCLES    (APRS_SAMPLE_PER + 1UL)
+#define APRS_SAMPLES_PER_BIT  8
+
+/* 65536 * hz / sample rate, rounded */
+#define APRS_INC(hz)  ((uint16_t) ((((hz) * APRS_SAMPLE_CYCLES * 512) +     \
+                                    (F_CPU / 256)) / (F_CPU / 128)))
+#define APRS_MARK_INC         APRS_INC(1200)
+#define APRS_SPACE_INC        APRS_INC(2200)
+
+/*
+ * Mid scale, and 127 * 14 = 1778 steps either side of it: at about 0.6Hz
+ * per step, about 1.1kHz deviation, which is as much as the DAC has.
+ */
+#define APRS_CENTRE           2048
+#define APRS_GAIN             14
+
+#define APRS_PREAMBLE         32
+#define APRS_TAIL             3
+#define APRS_MAX_INFO         256
+#define APRS_FLAG             0x7E
+#define APRS_CRC_POLY         0x8408
+
+/* See /misc-c/pc/tables/aprs.c */
+static int8_t aprs_sine[64] PROGMEM =
+    {    0,   12,   25,   37,   49,   60,   71,   81,
+        90,   98,  106,  112,  117,  122,  125,  126,
+       127,  126,  125,  122,  117,  112,  106,   98,
+        90,   81,   71,   60,   49,   37,   25,   12,
+         0,  -12,  -25,  -37,  -49,  -60,  -71,  -81,
+       -90,  -98, -106, -112, -117, -122, -125, -126,
+      -127, -126, -125, -122, -117, -112, -106,  -98,
+       -90,  -81,  -71,  -60,  -49,  -37,  -25,  -12 };
+
+/*
+ * Destination (APZ: experimental software), source and digipeater path,
+ * each a callsign padded to six characters with spaces and an SSID; -11
+ * is for balloons. APRS_CALLSIGN (at most six characters; shorter ones
+ * are padded as they're sent) must be set to the licensee's before
+ * flight, e.g. with make APRS_CALLSIGN=M0XYZ. After them come the control
+ * field (UI frame) and the PID (no layer 3).
+ */
+#ifndef APRS_CALLSIGN
+#define APRS_CALLSIGN   "NOCALL"
+#endif
+
+#define APRS_ADDRESSES  3
+#define APRS_CONTROL    (APRS_ADDRESSES * 7)
+#define APRS_PID        (APRS_CONTROL + 1)
+#define APRS_HEADER_LEN (APRS_PID + 1)
+
+static char aprs_calls[APRS_ADDRESSES][7] PROGMEM =
+    { "APZAL2", APRS_CALLSIGN, "WIDE2 " };
+static uint8_t aprs_ssids[APRS_ADDRESSES] PROGMEM = { 0, 11, 1 };
+
+#define STATUS_PREAMBLE 0
+#define STATUS_HEADER   1
+#define STATUS_INFO     2
+#define STATUS_FCS      3
+#define STATUS_TAIL     4
+#define STATUS_DONE     5
+
+#define APRS_END        2
+
+static uint8_t aprs_status, aprs_draining;
+static uint16_t aprs_count, aprs_crc;
+
+/* The byte going out: bits left, and whether it is bit stuffed */
+static uint8_t aprs_byte, aprs_bits, aprs_stuff, aprs_ones;
+
+/* aprs_tone is 0 for mark, 1 for space */
+static uint8_t aprs_tone, aprs_sample;
+static uint16_t aprs_phase;
+
+static void aprs_init()
+{
+    aprs_status = STATUS_PREAMBLE;
+    aprs_draining = 0;
+    aprs_count = 0;
+    aprs_crc = 0xFFFF;
+    aprs_bits = 0;
+    aprs_ones = 0;
+    aprs_tone = 0;
+    aprs_sample = 0;
+    aprs_phase = 0;
+
+    radio_hw_mode(RADIO_HW_MODE_TX);
+    radio_hw_dac_set(APRS_CENTRE);
+    radio_hw_dma_start(RADIO_HW_TIMER_DIV1, APRS_SAMPLE_PER);
+
+    /* radio_isr calls aprs_interrupt straight after this, for the second */
+    radio_hw_dma_queue(aprs_encode(radio_hw_dma_buffer()));
+}
+
+static uint8_t aprs_interrupt()
+{
+    uint8_t n;
+
+    if (!aprs_draining)
+    {
+        n = aprs_encode(radio_hw_dma_buffer());
+
+        if (n != 0)
+        {
+            radio_hw_dma_queue(n);
+            return RADIO_INTERRUPT_OK;
+        }
+
+        aprs_draining = 1;
+    }
+
+    return radio_hw_dma_drain();
+}
+
+static uint8_t aprs_encode(uint16_t *b)
+{
+    uint8_t n, bit;
+    int8_t s;
+
+    for (n = 0; n < RADIO_HW_DMA_BUFFER_LEN; n++)
+    {
+        if (aprs_sample == 0)
+        {
+            bit = aprs_next_bit();
+
+            if (bit == APRS_END)
+            {
+                break;
+            }
+
+            if (bit == 0)
+            {
+                aprs_tone ^= 1;
+            }
+        }
+
+        aprs_phase += (aprs_tone ? APRS_SPACE_INC : APRS_MARK_INC);
+        s = pgm_read_byte(&(aprs_sine[aprs_phase >> 10]));
+        b[n] = APRS_CENTRE + (s * APRS_GAIN);
+
+        aprs_sample++;
+
+        if (aprs_sample == APRS_SAMPLES_PER_BIT)
+        {
+            aprs_sample = 0;
+        }
+    }
+
+    return n;
+}
+
+/* 0, 1 or APRS_END */
+static uint8_t aprs_next_bit()
+{
+    uint8_t bit;
+
+    if (aprs_ones == 5)
+    {
+        aprs_ones = 0;
+        return 0;
+    }
+
+    if (aprs_bits == 0)
+    {
+        if (!aprs_next_byte())
+        {
+            return APRS_END;
+        }
+
+        aprs_bits = 8;
+    }
+
+    bit = aprs_byte & 0x01;
+    aprs_byte >>= 1;
+    aprs_bits--;
+
+    if (bit && aprs_stuff)
+    {
+        aprs_ones++;
+    }
+    else
+    {
+        aprs_ones = 0;
+    }
+
+    return bit;
+}
+
+/* Sets up the next byte of the frame, or returns 0 at the end of it */
+static uint8_t aprs_next_byte()
+{
+    switch (aprs_status)
+    {
+        case STATUS_PREAMBLE:
+            if (aprs_count < APRS_PREAMBLE)
+            {
+                aprs_flag();
+                return 1;
+            }
+
+            aprs_status = STATUS_HEADER;
+            aprs_count = 0;
+            /* fall through */
+
+        case STATUS_HEADER:
+            if (aprs_count < APRS_HEADER_LEN)
+            {
+                aprs_data(aprs_header_byte(aprs_count));
+                return 1;
+            }
+
+            aprs_status = STATUS_INFO;
+            aprs_count = 0;
+            /* fall through */
+
+        case STATUS_INFO:
+            if (aprs_count < APRS_MAX_INFO &&
+                radio_data_update() == DATA_SOURCE_OK)
+            {
+                aprs_data(radio_data_current_byte);
+                return 1;
+            }
+
+            /*
+             * A longer source is cut short, but must still finish here,
+             * or the next frame would start with the rest of it. What's
+             * skipped wasn't sent, so isn't counted (see radio_data_read).
+             */
+            if (aprs_count == APRS_MAX_INFO)
+            {
+                while (data_reader_read(&radio_data_reader, NULL, 255) == 255);
+            }
+
+            aprs_status = STATUS_FCS;
+            aprs_count = 0;
+            aprs_crc = ~aprs_crc;
+            /* fall through */
+
+        case STATUS_FCS:
+            if (aprs_count < 2)
+            {
+                /* Low byte first */
+                aprs_byte = aprs_crc;
+                aprs_stuff = 1;
+                aprs_crc >>= 8;
+                aprs_count++;
+                return 1;
+            }
+
+            aprs_status = STATUS_TAIL;
+            aprs_count = 0;
+            /* fall through */
+
+        case STATUS_TAIL:
+            if (aprs_count < APRS_TAIL)
+            {
+                aprs_flag();
+                return 1;
+            }
+
+            aprs_status = STATUS_DONE;
+            /* fall through */
+
+        default:
+            return 0;
+    }
+}
+
+static void aprs_flag()
+{
+    aprs_byte = APRS_FLAG;
+    aprs_stuff = 0;
+    aprs_count++;
+}
+
+/* A byte of the header or information field, which the FCS covers */
+static void aprs_data(uint8_t c)
+{
+    uint8_t i;
+
+    aprs_byte = c;
+    aprs_stuff = 1;
+    aprs_count++;
+
+    aprs_crc ^= c;
+
+    for (i = 0; i < 8; i++)
+    {
+        if (aprs_crc & 0x0001)
+        {
+            aprs_crc = (aprs_crc >> 1) ^ APRS_CRC_POLY;
+        }
+        else
+        {
+            aprs_crc >>= 1;
+        }
+    }
+}
+
+/*
+ * Callsign characters are shifted up one bit. The SSID byte of the
+ * destination has the command bit set (AX.25 v2), and that of the last
+ * address has the end bit.
+ */
+static uint8_t aprs_header_byte(uint8_t i)
+{
+    uint8_t a, b, c;
+
+    if (i == APRS_CONTROL)
+    {
+        return 0x03;
+    }
+    else if (i == APRS_PID)
+    {
+        return 0xF0;
+    }
+
+    a = i / 7;
+    i %= 7;
+
+    if (i < 6)
+    {
+        /* Past the end of a short callsign */
+        c = pgm_read_byte(&(aprs_calls[a][i]));
+
+        if (c == '\0')
+        {
+            c = ' ';
+        }
+
+        return c << 1;
+    }
+
+    b = 0x60 | (pgm_read_byte(&(aprs_ssids[a])) << 1);
+
+    if (a == 0)
+    {
+        b |= 0x80;
+    }
+
+    if (a == APRS_ADDRESSES - 1)
+    {
+        b |= 0x01;
+    }
+
+    return b;
+}
+
+/* Bit stuffing, which is rare in text, isn't counted */
+static uint32_t aprs_airtime(uint8_t options, uint16_t len)
+{
+    uint32_t bits;
+
+    if (len > APRS_MAX_INFO)
+    {
+        len = APRS_MAX_INFO;
+    }
+
+    bits = 8UL * (APRS_PREAMBLE + APRS_HEADER_LEN + len + 2 + APRS_TAIL);
+
+    return (bits * APRS_SAMPLES_PER_BIT * APRS_SAMPLE_CYCLES) /
+           (F_CPU / 1000);
+}
+
+static char aprs_short_name[] PROGMEM = "APRS";
+static char aprs_long_name[] PROGMEM = "APRS 1200 AFSK";
+
+static PGM_P aprs_getname(uint8_t t, uint8_t options)
+{
+    if (t == RADIO_NAME_SHORT)
+    {
+        return aprs_short_name;
+    }
+    else
+    {
+        return aprs_long_name;
+    }
+}
@@ -0,0 +1,25 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RADIO_APRS_H__
+#define __RADIO_APRS_H__
+
+#include "radio.h"
+
+extern const struct radio_mode aprs;
+
+#endif
@@ -39,72 +39,79 @@
 #include "radio.h"
 #include "hardware.h"
 #include "domex.h"
+#include "symbol.h"
 
 static void domex_init();
-static uint8_t domex_interrupt();
+static uint8_t domex_encode(struct radio_symbol *s);
 static PGM_P domex_getname(uint8_t t, uint8_t options);
+static uint32_t domex_airtime(uint8_t options, uint16_t len);
 static uint16_t domex_get_nibbles(uint8_t c);
 
-const struct radio_mode domex = { domex_init, domex_interrupt, domex_getname };
+const struct radio_mode domex = { domex_init, radio_symbol_isr,
+                                  domex_getname, domex_airtime,
+                                  radio_symbol_refill };
 
+/*
+ * Each nibble is one tone, and so one symbol. current_tone carries on from
+ * one item to the next, since tones are relative to the one before.
+ */
 static uint8_t current_tone;
 static uint16_t current_nibbles;
 
-static void domex_init()
-{
-    radio_hw_timer_set(RADIO_HW_TIMER_DIV8, 46500);
-    radio_hw_mode(RADIO_HW_MODE_TX);
-
-    /* don't reset current_tone */
-    radio_data_update();
-    current_nibbles = domex_get_nibbles(radio_data_current_byte);
-}
+/*
+ * Symbols are 46.5ms long, and our telemetry averages 2.25 symbols per
+ * character (digits take 2, punctuation 3)
+ */
+#define DOMEX_PER     46500  /* TCC0 ticks, at DIV8 */
+#define DOMEX_BYTE_MS 105
 
 #define NUM_TONES 18
 #define BASE_VALUE 2103
 #define TONE_SHIFT 36
 
-static uint8_t domex_interrupt()
+static void domex_init()
 {
-    uint8_t nibble;
-
-    nibble = current_nibbles & 0xF;
-    current_tone = (current_tone + 2 + nibble);
-
-    if (current_tone >= NUM_TONES)
-    {
-        current_tone -= NUM_TONES;
-    }
-
-    radio_hw_dac_set(BASE_VALUE + (current_tone * TONE_SHIFT));
+    current_nibbles = 0;
+    radio_symbol_start(RADIO_HW_TIMER_DIV8, domex_encode);
+}
 
+static uint8_t domex_encode(struct radio_symbol *s)
+{
     /*
      * domex_get_nibbles returns a 16bit value, 0x0cba where a, b, and c are
      * the nibbles to be sent, in that order. So we send a nibble and slide
-     * current_nibbles to the right.
-     */
-    current_nibbles >>= 4;
-
-    /*
+     * nibbles to the right.
+     *
      * The first nibble will not have the MSB set, but any multi-nibble
      * chars will have 0x08 set in their "continuation nibbles"
      */
-    if (current_nibbles & 0x08)
-    {
-        return RADIO_INTERRUPT_OK;
-    }
-    else
+    if (!(current_nibbles & 0x08))
     {
-        uint8_t source_status;
-        source_status = radio_data_update();
-
-        if (source_status == DATA_SOURCE_OK)
+        if (radio_data_update() != DATA_SOURCE_OK)
         {
-            current_nibbles = domex_get_nibbles(radio_data_current_byte);
+            return DATA_SOURCE_FINISHED;
         }
 
-        return source_status;
+        current_nibbles = domex_get_nibbles(radio_data_current_byte);
     }
+
+    current_tone = (current_tone + 2 + (current_nibbles & 0xF));
+
+    if (current_tone >= NUM_TONES)
+    {
+        current_tone -= NUM_TONES;
+    }
+
+    s->value = BASE_VALUE + (current_tone * TONE_SHIFT);
+    s->per = DOMEX_PER;
+    current_nibbles >>= 4;
+
+    return DATA_SOURCE_OK;
+}
+
+static uint32_t domex_airtime(uint8_t options, uint16_t len)
+{
+    return (uint32_t) len * DOMEX_BYTE_MS;
 }
 
 static char domex_short_name[] PROGMEM = "DmX22";
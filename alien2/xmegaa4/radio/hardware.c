@@ -18,38 +18,107 @@
 #include <stdint.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include "hardware.h"
 #include "radio.h"
+#include "../debug/profile.h"
+#include "../telem/monitor.h"
 
 #define RADIO_HW_MODE_PORT       PORTA
 #define RADIO_DAC                DACB
 #define RADIO_ADC                ADCA
 #define RADIO_ADC_INPUT_AF       (ADC_CH_MUXPOS_PIN0_gc | ADC_CH_MUXPOS3_bm)
 #define RADIO_ADC_INPUT_RSSI     (ADC_CH_MUXPOS_PIN1_gc | ADC_CH_MUXPOS3_bm)
+#define RADIO_ADC_INPUT_SUPPLY   (ADC_CH_MUXPOS_PIN2_gc | ADC_CH_MUXPOS3_bm)
 #define RADIO_ADC_CAPT_PREEMPT   10
 #define RADIO_HW_TIMER           TCC0
 #define RADIO_HW_EVCHMUX         CH0MUX
+#define RADIO_HW_EVCHMUX_RSSI    CH1MUX
 #define RADIO_HW_EVCHSRC         EVSYS_CHMUX_TCC0_CCA_gc
+#define RADIO_HW_DAC_EVSEL       DAC_EVSEL_0_gc
+#define RADIO_HW_DMA_CH_A        DMA.CH0
+#define RADIO_HW_DMA_CH_B        DMA.CH1
+#define RADIO_HW_DMA_DBUFMODE    DMA_DBUFMODE_CH01_gc
+#define RADIO_HW_DMA_DAC_TRIG    DMA_CH_TRIGSRC_DACB_CH0_gc
+#define RADIO_HW_DMA_ADC_TRIG    DMA_CH_TRIGSRC_ADCA_CH1_gc
+#define RADIO_HW_MONITOR_TIMER   TCD0
+#define RADIO_HW_MONITOR_EVCHSRC EVSYS_CHMUX_TCD0_OVF_gc
 
 static void radio_hw_dac_start();
 static void radio_hw_dac_stop();
 static void radio_hw_adc_init();
-static void radio_hw_adc_start();
-static void radio_hw_adc_stop();
 static void radio_hw_timer_init();
+static void radio_hw_monitor_init();
+static void radio_hw_dma_setup(uint8_t addrctrl, uint8_t trigsrc,
+                               uint16_t src, uint16_t dest);
+static void radio_hw_dma_arm(uint8_t i, uint8_t burstlen, uint16_t len);
+static void radio_hw_dma_stop();
 
-static uint8_t radio_hw_dac_running, radio_hw_adc_running;
+static uint8_t radio_hw_dac_running;
 static uint8_t radio_hw_adc_cca_decrement;
 
+/* CPU cycles per TCC0 period, and in total; see radio_hw_ticks */
+static uint32_t radio_hw_period, radio_hw_ticks_total;
+static uint8_t radio_hw_timer_shift;
+
+/* log2 of each prescaler, indexed by TC_CLKSEL_DIVn_gc - 1 */
+static uint8_t radio_hw_timer_shifts[] PROGMEM = { 0, 1, 2, 3, 6, 8, 10 };
+
+static DMA_CH_t *const radio_hw_dma_ch[2] = { &RADIO_HW_DMA_CH_A,
+                                              &RADIO_HW_DMA_CH_B };
+static uint16_t radio_hw_dma_last_value;
+static uint8_t radio_hw_dma_next, radio_hw_dma_drain_status;
+static uint8_t radio_hw_dma_len[2];
+
+/* TX playout and RX capture never run at the same time */
+static union
+{
+    uint16_t dac[2][RADIO_HW_DMA_BUFFER_LEN];
+    struct radio_hw_sample adc[2][RADIO_HW_CAPTURE_LEN];
+} radio_hw_dma_buf;
+
 ISR (TCC0_OVF_vect)
 {
+    profile_hi_begin();
+    radio_hw_ticks_total += radio_hw_period;
+    radio_isr();
+    profile_hi_end();
+}
+
+/*
+ * Transaction complete: one of the two playout buffers has been used up,
+ * or one of the two capture buffers has been filled
+ */
+ISR (DMA_CH0_vect)
+{
+    profile_hi_begin();
+    RADIO_HW_DMA_CH_A.CTRLB |= DMA_CH_TRNIF_bm;
+    radio_hw_ticks_total += radio_hw_period * radio_hw_dma_len[0];
     radio_isr();
+    profile_hi_end();
+}
+
+ISR (DMA_CH1_vect)
+{
+    profile_hi_begin();
+    RADIO_HW_DMA_CH_B.CTRLB |= DMA_CH_TRNIF_bm;
+    radio_hw_ticks_total += radio_hw_period * radio_hw_dma_len[1];
+    radio_isr();
+    profile_hi_end();
+}
+
+/* Background monitoring; see radio_hw_monitor_init */
+ISR (ADCA_CH3_vect)
+{
+    monitor_sample(RADIO_ADC.CH2.RES, RADIO_ADC.CH3.RES);
 }
 
 void radio_hw_init()
 {
     radio_hw_timer_init();
     radio_hw_adc_init();
+    radio_hw_monitor_init();
+    DMA.CTRL = DMA_ENABLE_bm;
 }
 
 static void radio_hw_dac_start()
@@ -70,6 +139,13 @@ void radio_hw_dac_set(uint16_t value)
     RADIO_DAC.CH0DATA = value;
 }
 
+/*
+ * Each ADC channel is started by its own event channel: CH0 (AF) and CH1
+ * (RSSI) by TCC0 CCA on event channels 0 and 1, and CH2 (RSSI) and CH3
+ * (supply) by the monitor timer on 2 and 3. CH1 and CH3 complete after
+ * CH0 and CH2, so they signal that a pair is ready. The ADC is always
+ * enabled, for the monitor; outside of RX nothing reads CH0 and CH1.
+ */
 static void radio_hw_adc_init()
 {
     RADIO_ADC.REFCTRL = ADC_REFSEL_VCC_gc;
@@ -77,21 +153,13 @@ static void radio_hw_adc_init()
     RADIO_ADC.CH0.MUXCTRL = RADIO_ADC_INPUT_AF;
     RADIO_ADC.CH1.CTRL = ADC_CH_INPUTMODE_SINGLEENDED_gc;
     RADIO_ADC.CH1.MUXCTRL = RADIO_ADC_INPUT_RSSI;
-    RADIO_ADC.EVCTRL = ADC_SWEEP_01_gc | ADC_EVSEL_0123_gc |
-                       ADC_EVACT_SWEEP_gc;
+    RADIO_ADC.CH2.CTRL = ADC_CH_INPUTMODE_SINGLEENDED_gc;
+    RADIO_ADC.CH2.MUXCTRL = RADIO_ADC_INPUT_RSSI;
+    RADIO_ADC.CH3.CTRL = ADC_CH_INPUTMODE_SINGLEENDED_gc;
+    RADIO_ADC.CH3.MUXCTRL = RADIO_ADC_INPUT_SUPPLY;
+    RADIO_ADC.EVCTRL = ADC_EVSEL_0123_gc | ADC_EVACT_CH0123_gc;
     RADIO_ADC.CTRLB = ADC_RESOLUTION_12BIT_gc;
-}
-
-static void radio_hw_adc_start()
-{
     RADIO_ADC.CTRLA = ADC_ENABLE_bm;
-    radio_hw_adc_running = 1;
-}
-
-static void radio_hw_adc_stop()
-{
-    RADIO_ADC.CTRLA = 0;
-    radio_hw_adc_running = 0;
 }
 
 void radio_hw_adc_get(uint16_t *af, uint16_t *rssi)
@@ -104,6 +172,23 @@ static void radio_hw_timer_init()
 {
     RADIO_HW_TIMER.INTCTRLA = TC_OVFINTLVL_HI_gc;
     EVSYS.RADIO_HW_EVCHMUX = RADIO_HW_EVCHSRC;
+    EVSYS.RADIO_HW_EVCHMUX_RSSI = RADIO_HW_EVCHSRC;
+}
+
+/*
+ * The monitor timer free runs, and is left alone by everything else.
+ * ADCA_CH3_vect is low level, so the radio's high level interrupts can
+ * preempt it; it does a few additions (and every 16th time, a few more),
+ * so it never delays anything by more than a few microseconds.
+ */
+static void radio_hw_monitor_init()
+{
+    EVSYS.CH2MUX = RADIO_HW_MONITOR_EVCHSRC;
+    EVSYS.CH3MUX = RADIO_HW_MONITOR_EVCHSRC;
+    RADIO_ADC.CH3.INTCTRL = ADC_CH_INTMODE_COMPLETE_gc | ADC_CH_INTLVL_LO_gc;
+
+    RADIO_HW_MONITOR_TIMER.PER = (F_CPU / RADIO_HW_MONITOR_HZ) - 1;
+    RADIO_HW_MONITOR_TIMER.CTRLA = TC_CLKSEL_DIV1_gc;
 }
 
 void radio_hw_timer_set(uint8_t div, uint16_t per)
@@ -118,12 +203,207 @@ void radio_hw_timer_set(uint8_t div, uint16_t per)
     RADIO_HW_TIMER.PER = per;
     RADIO_HW_TIMER.CCA = per - radio_hw_adc_cca_decrement;
     RADIO_HW_TIMER.CTRLA = div;
+
+    radio_hw_timer_shift = pgm_read_byte(&(radio_hw_timer_shifts[div - 1]));
+    radio_hw_period = ((uint32_t) per + 1) << radio_hw_timer_shift;
 }
 
 void radio_hw_queue_period_update(uint16_t per)
 {
     RADIO_HW_TIMER.PERBUF = per;
     RADIO_HW_TIMER.CCABUF = per - radio_hw_adc_cca_decrement;
+
+    /* Strictly, this only applies from the next overflow */
+    radio_hw_period = ((uint32_t) per + 1) << radio_hw_timer_shift;
+}
+
+uint32_t radio_hw_ticks()
+{
+    return radio_hw_ticks_total;
+}
+
+/*
+ * The DAC is put into event triggered mode on the same EVSYS channel that
+ * triggers ADC CH0 (TCC0 CCA), so each value is output exactly on the
+ * timer, regardless of when the DMA (or the CPU) wrote it. Each channel
+ * moves one 2 byte burst into CH0DATA whenever it is empty; CH0 and CH1
+ * are run in double buffer mode so that one plays while the other is
+ * refilled.
+ */
+void radio_hw_dma_start(uint8_t div, uint16_t per)
+{
+    radio_hw_dma_next = 0;
+    radio_hw_dma_drain_status = 0;
+
+    radio_hw_dma_setup(DMA_CH_SRCRELOAD_TRANSACTION_gc | DMA_CH_SRCDIR_INC_gc |
+                       DMA_CH_DESTRELOAD_BURST_gc | DMA_CH_DESTDIR_INC_gc,
+                       RADIO_HW_DMA_DAC_TRIG, 0,
+                       (uint16_t) &(RADIO_DAC.CH0DATA));
+
+    /* From now on radio_isr is called by the DMA interrupts instead */
+    RADIO_HW_TIMER.INTCTRLA = TC_OVFINTLVL_OFF_gc;
+    radio_hw_timer_set(div, per);
+
+    RADIO_DAC.EVCTRL = RADIO_HW_DAC_EVSEL;
+    RADIO_DAC.CTRLB = DAC_CHSEL_SINGLE_gc | DAC_CH0TRIG_bm;
+    DMA.CTRL = DMA_ENABLE_bm | RADIO_HW_DMA_DBUFMODE;
+}
+
+uint16_t *radio_hw_dma_buffer()
+{
+    return radio_hw_dma_buf.dac[radio_hw_dma_next];
+}
+
+void radio_hw_dma_queue(uint8_t len)
+{
+    uint16_t *buf;
+
+    buf = radio_hw_dma_buf.dac[radio_hw_dma_next];
+    radio_hw_dma_ch[radio_hw_dma_next]->SRCADDR0 = ((uint16_t) buf) & 0xFF;
+    radio_hw_dma_ch[radio_hw_dma_next]->SRCADDR1 = ((uint16_t) buf) >> 8;
+    radio_hw_dma_arm(radio_hw_dma_next, DMA_CH_BURSTLEN_2BYTE_gc, len * 2);
+    radio_hw_dma_len[radio_hw_dma_next] = len;
+
+    radio_hw_dma_last_value = buf[len - 1];
+    radio_hw_dma_next ^= 1;
+}
+
+/*
+ * A transaction completes when its last value has been written to CH0DATA,
+ * which is while the value before it is still being output. So that the
+ * last value gets its full period, it is followed by a one value "pad"
+ * buffer that repeats it; when the pad's transaction completes, the last
+ * value is being output and there's nothing left to wait for.
+ */
+#define DRAIN_FINAL 0  /* the final buffer is playing: queue the pad */
+#define DRAIN_PAD   1  /* the pad is playing: don't restart the final */
+#define DRAIN_DONE  2
+
+uint8_t radio_hw_dma_drain()
+{
+    if (radio_hw_dma_drain_status == DRAIN_FINAL)
+    {
+        radio_hw_dma_buf.dac[radio_hw_dma_next][0] = radio_hw_dma_last_value;
+        radio_hw_dma_queue(1);
+    }
+    else if (radio_hw_dma_drain_status == DRAIN_PAD)
+    {
+        DMA.CTRL = DMA_ENABLE_bm;
+    }
+    else
+    {
+        radio_hw_dma_stop();
+        return RADIO_HW_DMA_DONE;
+    }
+
+    radio_hw_dma_drain_status++;
+    return RADIO_HW_DMA_BUSY;
+}
+
+/*
+ * ADC CH0 (AF) and CH1 (RSSI) are already started by the TCC0 CCA event;
+ * when CH1 completes, DMA copies both results (CH0RES and CH1RES are
+ * adjacent) into the capture buffer as one 4 byte burst. CH0 and CH1
+ * alternate filling the two buffers in double buffer mode, and each one
+ * interrupts when its buffer is full.
+ */
+void radio_hw_capture_start(uint8_t div, uint16_t per)
+{
+    uint8_t i;
+
+    radio_hw_dma_next = 0;
+
+    radio_hw_dma_setup(DMA_CH_SRCRELOAD_BURST_gc | DMA_CH_SRCDIR_INC_gc |
+                       DMA_CH_DESTRELOAD_TRANSACTION_gc |
+                       DMA_CH_DESTDIR_INC_gc,
+                       RADIO_HW_DMA_ADC_TRIG,
+                       (uint16_t) &(RADIO_ADC.CH0RES), 0);
+
+    for (i = 0; i < 2; i++)
+    {
+        uint16_t dest = (uint16_t) radio_hw_dma_buf.adc[i];
+
+        radio_hw_dma_ch[i]->DESTADDR0 = dest & 0xFF;
+        radio_hw_dma_ch[i]->DESTADDR1 = dest >> 8;
+        radio_hw_dma_arm(i, DMA_CH_BURSTLEN_4BYTE_gc,
+                         sizeof(radio_hw_dma_buf.adc[i]));
+        radio_hw_dma_len[i] = RADIO_HW_CAPTURE_LEN;
+    }
+
+    RADIO_HW_TIMER.INTCTRLA = TC_OVFINTLVL_OFF_gc;
+    radio_hw_timer_set(div, per);
+    DMA.CTRL = DMA_ENABLE_bm | RADIO_HW_DMA_DBUFMODE;
+}
+
+/*
+ * Returns the buffer that has just been filled, and re-arms its channel
+ * to take over once the other fills up. So the samples must be dealt with
+ * within RADIO_HW_CAPTURE_LEN sample periods.
+ */
+struct radio_hw_sample *radio_hw_capture_block()
+{
+    struct radio_hw_sample *block;
+
+    block = radio_hw_dma_buf.adc[radio_hw_dma_next];
+    radio_hw_dma_arm(radio_hw_dma_next, DMA_CH_BURSTLEN_4BYTE_gc,
+                     sizeof(radio_hw_dma_buf.adc[0]));
+    radio_hw_dma_next ^= 1;
+
+    return block;
+}
+
+void radio_hw_capture_stop()
+{
+    radio_hw_dma_stop();
+}
+
+/* Common to playout and capture: one of src and dest is set per channel */
+static void radio_hw_dma_setup(uint8_t addrctrl, uint8_t trigsrc,
+                               uint16_t src, uint16_t dest)
+{
+    uint8_t i;
+
+    for (i = 0; i < 2; i++)
+    {
+        DMA_CH_t *ch = radio_hw_dma_ch[i];
+
+        ch->CTRLA = 0;
+        ch->CTRLB = DMA_CH_TRNINTLVL_HI_gc;
+        ch->ADDRCTRL = addrctrl;
+        ch->TRIGSRC = trigsrc;
+        ch->SRCADDR0 = src & 0xFF;
+        ch->SRCADDR1 = src >> 8;
+        ch->SRCADDR2 = 0;
+        ch->DESTADDR0 = dest & 0xFF;
+        ch->DESTADDR1 = dest >> 8;
+        ch->DESTADDR2 = 0;
+    }
+}
+
+static void radio_hw_dma_arm(uint8_t i, uint8_t burstlen, uint16_t len)
+{
+    radio_hw_dma_ch[i]->TRFCNT = len;
+    radio_hw_dma_ch[i]->CTRLA = DMA_CH_ENABLE_bm | DMA_CH_SINGLE_bm |
+                                burstlen;
+}
+
+static void radio_hw_dma_stop()
+{
+    RADIO_HW_DMA_CH_A.CTRLA = 0;
+    RADIO_HW_DMA_CH_B.CTRLA = 0;
+    DMA.CTRL = DMA_ENABLE_bm;
+
+    /*
+     * After playout, the pad left in CH0DATA is converted immediately;
+     * it's the same value that is being output anyway.
+     */
+    RADIO_DAC.CTRLB = DAC_CHSEL_SINGLE_gc;
+
+    /*
+     * Don't restart the timer: after playout the next overflow ends the
+     * last value
+     */
+    RADIO_HW_TIMER.INTCTRLA = TC_OVFINTLVL_HI_gc;
 }
 
 /*
@@ -147,15 +427,9 @@ void radio_hw_mode(uint8_t mode)
 
     RADIO_HW_MODE_PORT.DIRCLR = RADIO_HW_MODE_BITS;
 
-    if (mode != RADIO_HW_MODE_RX && radio_hw_adc_running)
-        radio_hw_adc_stop();
-
     if (mode != RADIO_HW_MODE_TX && radio_hw_dac_running)
         radio_hw_dac_stop();
 
-    if (mode == RADIO_HW_MODE_RX && !radio_hw_adc_running)
-        radio_hw_adc_start();
-
     if (mode == RADIO_HW_MODE_TX && !radio_hw_dac_running)
         radio_hw_dac_start();
 
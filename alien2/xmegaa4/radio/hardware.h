@@ -35,11 +35,66 @@
 #define RADIO_HW_MODE_TX   (1 << 6)
 #define RADIO_HW_MODE_BITS (RADIO_HW_MODE_RX | RADIO_HW_MODE_TX)
 
+/*
+ * DMA symbol playout: while running, the DAC converts once per timer period
+ * (on the TCC0 CCA event) and DMA refills it from a buffer of DAC values,
+ * so the CPU is only woken (via radio_isr) when a buffer has been used up.
+ * Two buffers are used alternately; fill radio_hw_dma_buffer() and then
+ * radio_hw_dma_queue() it. Once there is nothing left to queue, call
+ * radio_hw_dma_drain() from each subsequent radio_isr until it returns
+ * RADIO_HW_DMA_DONE, at which point the last value has been output and
+ * TCC0 overflow interrupts have resumed.
+ *
+ * RADIO_HW_DMA_BUSY must equal RADIO_INTERRUPT_OK and RADIO_HW_DMA_DONE
+ * must equal RADIO_INTERRUPT_FINISHED
+ */
+/* An rtty character in half bits (see rtty.c) fits in one buffer */
+#define RADIO_HW_DMA_BUFFER_LEN 24
+#define RADIO_HW_DMA_BUSY       0
+#define RADIO_HW_DMA_DONE       1
+
+/*
+ * DMA capture: the same two DMA channels copy each AF/RSSI pair into one
+ * of two blocks of RADIO_HW_CAPTURE_LEN samples; radio_isr is called once
+ * per full block, and should collect it with radio_hw_capture_block().
+ */
+#define RADIO_HW_CAPTURE_LEN 32
+
+struct radio_hw_sample
+{
+    uint16_t af;
+    uint16_t rssi;
+};
+
+/*
+ * Background monitoring: RADIO_HW_MONITOR_HZ times a second, whatever the
+ * radio is doing, ADC CH2 and CH3 convert the RSSI line and the supply
+ * (through a divider; against VCC, so it reads the divider's ratio) on
+ * their own timer, and each pair of readings goes to monitor_sample (see
+ * telem/monitor.c) from a low level interrupt. It starts with
+ * radio_hw_init, and never holds up radio_isr.
+ */
+#define RADIO_HW_MONITOR_HZ 2000
+
 void radio_hw_init();
 void radio_hw_dac_set(uint16_t value);
 void radio_hw_adc_get(uint16_t *af, uint16_t *rssi);
 void radio_hw_timer_set(uint8_t div, uint16_t per);
 void radio_hw_mode(uint8_t mode);
 void radio_hw_queue_period_update(uint16_t per);
+void radio_hw_dma_start(uint8_t div, uint16_t per);
+uint16_t *radio_hw_dma_buffer();
+void radio_hw_dma_queue(uint8_t len);
+uint8_t radio_hw_dma_drain();
+void radio_hw_capture_start(uint8_t div, uint16_t per);
+struct radio_hw_sample *radio_hw_capture_block();
+void radio_hw_capture_stop();
+
+/*
+ * TCC0 time elapsed since radio_hw_init, in CPU cycles, modulo 2^32. It is
+ * counted a period (or a DMA transaction) at a time, so it is only exact
+ * when read from radio_isr.
+ */
+uint32_t radio_hw_ticks();
 
 #endif
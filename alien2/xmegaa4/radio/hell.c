@@ -22,45 +22,37 @@
 #include "radio.h"
 #include "hardware.h"
 #include "hell.h"
+#include "symbol.h"
 
 static void hell_init();
-static uint8_t hell_interrupt();
+static uint8_t hell_encode(struct radio_symbol *s);
 static PGM_P hell_getname(uint8_t t, uint8_t options);
+static uint32_t hell_airtime(uint8_t options, uint16_t len);
 static uint8_t helltab_get_data(uint8_t c, uint8_t n);
 
-const struct radio_mode hell = { hell_init, hell_interrupt, hell_getname };
+const struct radio_mode hell = { hell_init, radio_symbol_isr, hell_getname,
+                                 hell_airtime, radio_symbol_refill };
 
 #define HELL_FREQ  2100
 #define HELL_LINES 7
 #define HELL_BITS  7
+
+/* HELL_LINES * HELL_BITS pixels of 8.175ms, each one symbol */
+#define HELL_PER     32700  /* TCC0 ticks, at DIV2 */
+#define HELL_BYTE_MS 401
 static uint8_t current_bit, current_line, current_line_num;
 
 static void hell_init()
 {
-    radio_hw_timer_set(RADIO_HW_TIMER_DIV2, 32700);
-    radio_hw_mode(RADIO_HW_MODE_TXOFF);
-
-    radio_data_update();
-    current_line = helltab_get_data(radio_data_current_byte, 0);
+    /* hell_encode will move on to the first line of the first byte */
+    current_bit = HELL_BITS;
+    current_line_num = HELL_LINES - 1;
 
-    current_bit = 0;
-    current_line_num = 0;
+    radio_symbol_start(RADIO_HW_TIMER_DIV2, hell_encode);
 }
 
-static uint8_t hell_interrupt()
+static uint8_t hell_encode(struct radio_symbol *s)
 {
-    if (current_line & (0x80 >> current_bit))
-    {
-        radio_hw_dac_set(HELL_FREQ);
-        radio_hw_mode(RADIO_HW_MODE_TX);
-    }
-    else
-    {
-        radio_hw_mode(RADIO_HW_MODE_TXOFF);
-    }
-
-    current_bit++;
-
     if (current_bit >= HELL_BITS)
     {
         current_bit = 0;
@@ -68,26 +60,31 @@ static uint8_t hell_interrupt()
 
         if (current_line_num >= HELL_LINES)
         {
-            uint8_t source_status;
-
             current_line_num = 0;
-            source_status = radio_data_update();
 
-            if (source_status == DATA_SOURCE_OK)
+            if (radio_data_update() != DATA_SOURCE_OK)
             {
-                current_line = helltab_get_data(radio_data_current_byte, 0);
+                return DATA_SOURCE_FINISHED;
             }
-
-            return source_status;
-        }
-        else
-        {
-            current_line = helltab_get_data(radio_data_current_byte,
-                                            current_line_num);
         }
+
+        current_line = helltab_get_data(radio_data_current_byte,
+                                        current_line_num);
+    }
+
+    if (current_line & (0x80 >> current_bit))
+    {
+        s->value = HELL_FREQ;
+    }
+    else
+    {
+        s->value = RADIO_SYMBOL_TXOFF;
     }
 
-    return RADIO_INTERRUPT_OK;
+    s->per = HELL_PER;
+    current_bit++;
+
+    return DATA_SOURCE_OK;
 }
 
 static char hell_short_name[] PROGMEM = "HELL";
@@ -105,6 +102,11 @@ static PGM_P hell_getname(uint8_t t, uint8_t options)
     }
 }
 
+static uint32_t hell_airtime(uint8_t options, uint16_t len)
+{
+    return (uint32_t) len * HELL_BYTE_MS;
+}
+
 /*
  * The alphabet below has been arranged such that it consumes much less ROM.
  * You can see how it looked before and inspect the code that generated it in
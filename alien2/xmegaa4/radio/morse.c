@@ -33,99 +33,100 @@
 #include "radio.h"
 #include "hardware.h"
 #include "morse.h"
+#include "symbol.h"
 
 static void morse_init();
-static uint8_t morse_interrupt();
+static uint8_t morse_encode(struct radio_symbol *s);
 static PGM_P morse_getname(uint8_t t, uint8_t options);
+static uint32_t morse_airtime(uint8_t options, uint16_t len);
 static uint8_t morse_get_data(uint8_t c);
 
-const struct radio_mode morse = { morse_init, morse_interrupt, morse_getname };
+const struct radio_mode morse = { morse_init, radio_symbol_isr,
+                                  morse_getname, morse_airtime,
+                                  radio_symbol_refill };
 
 static uint8_t current_data, current_state;
 
 #define MORSE_FREQ   2100
 
-#define STATE_START  0
-#define STATE_STOP   10
-#define STATE_NSTOP  20 /* get a new byte, then continue */
 /*
- * state is incremented 1 every interrupt. If state is set to STATE_DASH,
- * it will interrupt 3 times before reaching STATE_STOP
+ * A unit is 40ms (approx 26WPM). A dit is keyed for 2 units and a dash 4,
+ * each followed by a 1 unit gap; after the last element of a character
+ * the gap is 4 units instead, and a space adds 7. Letters and digits
+ * average about 20 units.
  */
-#define STATE_DIT    (STATE_STOP - 1)
-#define STATE_DASH   (STATE_STOP - 3)
-#define STATE_SPACE  (STATE_NSTOP - 5) /* plus two gaps makes 7 */
-#define STATE_CHRGAP (STATE_NSTOP - 1) /* plus two gaps makes 3 */
+#define MORSE_UNIT      5001  /* TCC0 ticks, at DIV64 */
+#define MORSE_PER(n)    (((n) * MORSE_UNIT) - 1)
+#define MORSE_BYTE_MS   (20 * 40)
+
+#define STATE_NEXT      0  /* get a new byte, then continue */
+#define STATE_ELEMENT   1
+#define STATE_GAP       2
 
 static void morse_init()
 {
-    /* approx 26WPM */
-    radio_hw_timer_set(RADIO_HW_TIMER_DIV64, 5000);
-    radio_hw_mode(RADIO_HW_MODE_TXOFF);
-
-    radio_data_update();
-    current_data = morse_get_data(radio_data_current_byte);
-
-    current_state = STATE_START;
+    current_state = STATE_NEXT;
+    radio_symbol_start(RADIO_HW_TIMER_DIV64, morse_encode);
 }
 
-static uint8_t morse_interrupt()
+static uint8_t morse_encode(struct radio_symbol *s)
 {
-    uint8_t source_status;
+    s->value = RADIO_SYMBOL_TXOFF;
+
+    if (current_state == STATE_GAP)
+    {
+        if (current_data == 0x01)
+        {
+            s->per = MORSE_PER(4);
+            current_state = STATE_NEXT;
+        }
+        else
+        {
+            s->per = MORSE_PER(1);
+            current_state = STATE_ELEMENT;
+        }
+
+        return DATA_SOURCE_OK;
+    }
+
+    if (current_state == STATE_NEXT)
+    {
+        if (radio_data_update() != DATA_SOURCE_OK)
+        {
+            return DATA_SOURCE_FINISHED;
+        }
 
-    switch (current_state)
+        current_data = morse_get_data(radio_data_current_byte);
+    }
+
+    if (current_data == 0x00)
+    {
+        s->per = MORSE_PER(7);
+        current_state = STATE_NEXT;
+    }
+    else if (current_data == 0x01)
     {
-        case STATE_START:
-            if (current_data == 0x00)
-            {
-                current_state = STATE_SPACE;
-            }
-            else if (current_data == 0x01)
-            {
-                current_state = STATE_CHRGAP;
-            }
-            else
-            {
-                radio_hw_dac_set(MORSE_FREQ);
-                radio_hw_mode(RADIO_HW_MODE_TX);
-
-                if (current_data & 0x01)
-                {
-                    current_state = STATE_DASH;
-                }
-                else
-                {
-                    current_state = STATE_DIT;
-                }
-
-                current_data = (current_data >> 1);
-            }
-            break;
-
-        case STATE_STOP:
-            /* wait for a dit-length gap, then start again */
-            radio_hw_mode(RADIO_HW_MODE_TXOFF);
-            current_state = STATE_START;
-            break;
-
-        case STATE_NSTOP:
-            source_status = radio_data_update();
-
-            if (source_status != DATA_SOURCE_OK)
-            {
-                return RADIO_INTERRUPT_FINISHED;
-            }
-
-            current_data = morse_get_data(radio_data_current_byte);
-            current_state = STATE_START;
-            break;
-
-        default:
-            current_state++;
-            break;
+        s->per = MORSE_PER(3);
+        current_state = STATE_NEXT;
+    }
+    else
+    {
+        s->value = MORSE_FREQ;
+
+        if (current_data & 0x01)
+        {
+            s->per = MORSE_PER(4);
+        }
+        else
+        {
+            s->per = MORSE_PER(2);
+        }
+
+        current_data = (current_data >> 1);
+        current_state = STATE_GAP;
     }
 
-    return RADIO_INTERRUPT_OK;
+    return DATA_SOURCE_OK;
 }
 
 static char morse_name[] PROGMEM = "Morse";
@@ -134,6 +135,10 @@ static PGM_P morse_getname(uint8_t t, uint8_t options)
     return morse_name;
 }
 
+static uint32_t morse_airtime(uint8_t options, uint16_t len)
+{
+    return (uint32_t) len * MORSE_BYTE_MS;
+}
 
 /*
  * The alphabet below has been arranged such that it consumes much less ROM.
@@ -17,10 +17,15 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 
 #include "../util.h"
 #include "../data.h"
+#include "../debug/debug.h"
+#include "../debug/trace.h"
 
 #include "radio.h"
 #include "hardware.h"
@@ -35,13 +40,46 @@
 #define STATUS_POSTDELAY    4
 #define STATUS_END          5
 
+/* PREDELAY and POSTDELAY */
+#define RADIO_DELAY_MS      1000
+
 static void item_finished();
 static void initialise_wait();
 static void announce_source_init(uint8_t t);
-static uint8_t announce_source(uint8_t *b);
 
-const struct radio_state announce_morse = { &morse, announce_source, 0 };
-struct radio_state announce_data = { NULL, announce_source, 0 };
+#if DEBUG
+static void radio_stats_bytes(uint16_t n);
+static void radio_stats_count();
+static void radio_stats_select();
+static void radio_stats_snapshot();
+#else
+#define radio_stats_count()
+#define radio_stats_select()
+#endif
+
+/*
+ * The morse announce is the short name; the data announce (in the old
+ * mode) is a header, a newline and then the long name.
+ */
+static char announce_header[] PROGMEM = "--- Switching to mode ---";
+static char announce_newline[] PROGMEM = "\n";
+
+static struct data_flash announce_header_source =
+    DATA_FLASH((const uint8_t *) announce_header,
+               sizeof(announce_header) - 1);
+static struct data_flash announce_newline_source =
+    DATA_FLASH((const uint8_t *) announce_newline,
+               sizeof(announce_newline) - 1);
+static struct data_flash announce_name = DATA_FLASH(NULL, 0);
+
+static struct data_source *const announce_parts[] =
+    { &announce_header_source.source, &announce_newline_source.source,
+      &announce_name.source };
+static struct data_concat announce_long = DATA_CONCAT(announce_parts, 3);
+
+const struct radio_state announce_morse = { &morse, &announce_name.source,
+                                            0 };
+struct radio_state announce_data = { NULL, &announce_long.source, 0 };
 
 const struct radio_state *radio_current_state;
 static const struct radio_state *next_state;
@@ -49,6 +87,7 @@ static uint8_t radio_status;
 static uint8_t current_item_status = RADIO_INTERRUPT_OK;
 
 uint8_t radio_data_current_byte;
+struct data_reader radio_data_reader;
 
 void radio_init()
 {
@@ -84,8 +123,25 @@ void radio_isr()
     current_item_status = radio_current_state->mode->isr();
 }
 
+void radio_refill()
+{
+    const struct radio_state *state;
+    uint8_t sreg;
+
+    sreg = SREG;
+    cli();
+    state = radio_current_state;
+    SREG = sreg;
+
+    if (state != NULL && state->mode->refill != NULL)
+    {
+        state->mode->refill();
+    }
+}
+
 static void item_finished()
 {
+    radio_stats_count();
     radio_status++;
 
     if (radio_status >= STATUS_END)
@@ -118,7 +174,9 @@ static void item_finished()
              * If the next item's mode is the same as this one, jump back to
              * RUNNING. Otherwise, leave status as FINISHED and select 
              * announce_data. If this mode cannot announce_data, jump past
-             * it to POSTDELAY.
+             * it to POSTDELAY: an item without a source (the uplink
+             * receiver) sends nothing, and running its mode again to
+             * announce would be another whole slot of it.
              */
             if (next_state->mode == radio_current_state->mode &&
                 next_state->options == radio_current_state->options)
@@ -126,7 +184,7 @@ static void item_finished()
                 radio_status = STATUS_RUNNING;
                 goto running_jump;
             }
-            else if (0 /* TODO can't announce data */)
+            else if (radio_current_state->source == NULL)
             {
                 radio_status = STATUS_POSTDELAY;
                 goto postdelay_jump;
@@ -141,9 +199,12 @@ static void item_finished()
             break;
     }
 
+    radio_stats_select();
+
     if (radio_current_state != NULL)
     {
         current_item_status = RADIO_INTERRUPT_OK;
+        data_reader_start(&radio_data_reader, radio_current_state->source);
         radio_current_state->mode->init();
     }
 }
@@ -152,65 +213,214 @@ static void initialise_wait()
 {
     current_item_status = RADIO_INTERRUPT_DELAY;
     radio_current_state = NULL;
+
+    /* RADIO_DELAY_MS */
     radio_hw_timer_set(RADIO_HW_TIMER_DIV256, 31250);
     radio_hw_mode(RADIO_HW_MODE_IDLE);
 }
 
-#define ASTATUS_HEADER 0
-#define ASTATUS_NAME   1
-
-static char announce_header[] PROGMEM = "--- Switching to mode ---";
+static void announce_source_init(uint8_t t)
+{
+    PGM_P name;
 
-static PGM_P announce_name;
-static uint8_t announce_pos, announce_status;
+    name = next_state->mode->getname(t, next_state->options);
+    announce_name.data = (const uint8_t *) name;
+    announce_name.len = strlen_P(name);
+    announce_name.pos = 0;
+}
 
-static void announce_source_init(uint8_t t)
+/*
+ * The time item_finished spends between from and to: announcing to (in
+ * from's mode, unless from has no source), POSTDELAY, the morse announce
+ * and PREDELAY. from is NULL at startup, which goes straight to the morse
+ * announce.
+ */
+uint32_t radio_switch_airtime(const struct radio_state *from,
+                              const struct radio_state *to)
 {
-    if (t == RADIO_NAME_SHORT)
+    uint32_t t;
+    uint16_t len;
+
+    if (from != NULL && from->mode == to->mode &&
+        from->options == to->options)
+    {
+        return 0;
+    }
+
+    len = strlen_P(to->mode->getname(RADIO_NAME_SHORT, to->options));
+    t = morse.airtime(0, len) + RADIO_DELAY_MS;
+
+    if (from != NULL)
     {
-        /* Skip header */
-        announce_status = ASTATUS_NAME;
+        t += RADIO_DELAY_MS;
     }
-    else
+
+    if (from != NULL && from->source != NULL)
     {
-        announce_status = ASTATUS_HEADER;
+        /* The header, then a newline, then the name */
+        len = sizeof(announce_header) +
+              strlen_P(to->mode->getname(RADIO_NAME_LONG, to->options));
+        t += from->mode->airtime(from->options, len);
     }
 
-    announce_pos = 0;
-    announce_name = next_state->mode->getname(t, next_state->options);
+    return t;
 }
 
-static uint8_t announce_source(uint8_t *b)
+#if DEBUG
+
+/*
+ * Airtime accounting: for each mode (and options) we count the TCC0 time
+ * spent in each radio_status phase, the payload bytes sent while RUNNING
+ * and the number of times we've switched to it. Everything it takes to
+ * switch to a mode (announces and delays) is counted against that mode,
+ * i.e., against next_state. Times are in units of RADIO_STATS_UNIT CPU
+ * cycles.
+ *
+ * Every RADIO_STATS_PERIOD, a snapshot goes out as a TRACE_RADIO_STATS
+ * record per mode. Values are totals since startup:
+ *
+ *   <total time, all modes: 4> <options: 1> <switches: 2> <bytes: 4>
+ *   <time: 4> * RADIO_STATS_PHASES <short name>
+ */
+#define RADIO_STATS_MODES   8
+#define RADIO_STATS_PHASES  STATUS_END
+#define RADIO_STATS_SHIFT   10
+#define RADIO_STATS_UNIT    (1UL << RADIO_STATS_SHIFT)
+#define RADIO_STATS_PERIOD  ((60UL * F_CPU) / RADIO_STATS_UNIT)
+
+struct radio_stats
+{
+    const struct radio_mode *mode;
+    uint8_t options;
+    uint16_t switches;
+    uint32_t bytes;
+    uint32_t time[RADIO_STATS_PHASES];
+};
+
+static struct radio_stats radio_stats[RADIO_STATS_MODES];
+static struct radio_stats *radio_stats_current;
+static uint32_t radio_stats_last, radio_stats_total, radio_stats_next;
+
+uint8_t radio_data_update()
 {
-    PGM_P s;
-    uint8_t c;
+    uint8_t status;
+
+    status = data_reader_byte(&radio_data_reader, &radio_data_current_byte);
 
-    if (announce_status == ASTATUS_HEADER)
+    if (status == DATA_SOURCE_OK)
     {
-        s = announce_header;
+        radio_stats_bytes(1);
     }
-    else
+
+    return status;
+}
+
+uint16_t radio_data_read(uint8_t *buf, uint16_t len)
+{
+    uint16_t n;
+
+    n = data_reader_read(&radio_data_reader, buf, len);
+    radio_stats_bytes(n);
+    return n;
+}
+
+static void radio_stats_bytes(uint16_t n)
+{
+    if (radio_status == STATUS_RUNNING && radio_stats_current != NULL)
+    {
+        radio_stats_current->bytes += n;
+    }
+}
+
+/* Count the time since the last call against the phase that just ended */
+static void radio_stats_count()
+{
+    uint32_t units;
+
+    /* Keep the remainder in radio_stats_last, so nothing is lost */
+    units = (radio_hw_ticks() - radio_stats_last) >> RADIO_STATS_SHIFT;
+    radio_stats_last += units << RADIO_STATS_SHIFT;
+
+    if (radio_stats_current == NULL)
     {
-        s = announce_name;
+        /* radio_init */
+        return;
     }
 
-    c = pgm_read_byte(&(s[announce_pos]));
-    announce_pos++;
+    radio_stats_current->time[radio_status] += units;
+    radio_stats_total += units;
 
-    if (c == '\0')
+    if (radio_stats_total >= radio_stats_next)
     {
-        if (announce_status == ASTATUS_HEADER)
+        radio_stats_next = radio_stats_total + RADIO_STATS_PERIOD;
+        radio_stats_snapshot();
+    }
+}
+
+static void radio_stats_select()
+{
+    uint8_t i;
+
+    radio_stats_current = NULL;
+
+    for (i = 0; i < RADIO_STATS_MODES; i++)
+    {
+        if (radio_stats[i].mode == NULL)
         {
-            announce_pos = 0;
-            announce_status = ASTATUS_NAME;
-            c = '\n';
+            radio_stats[i].mode = next_state->mode;
+            radio_stats[i].options = next_state->options;
         }
-        else
+
+        if (radio_stats[i].mode == next_state->mode &&
+            radio_stats[i].options == next_state->options)
         {
-            return DATA_SOURCE_FINISHED;
+            radio_stats_current = &radio_stats[i];
+            break;
         }
     }
 
-    *b = c;
-    return DATA_SOURCE_OK;
+    if (radio_stats_current != NULL && radio_status == STATUS_INIT)
+    {
+        radio_stats_current->switches++;
+    }
+}
+
+#define RADIO_STATS_RECORD_LEN (11 + (4 * RADIO_STATS_PHASES))
+
+static void radio_stats_snapshot()
+{
+    struct radio_stats *s;
+    PGM_P name;
+    uint8_t *p;
+    uint8_t i, j, name_len;
+
+    for (i = 0; i < RADIO_STATS_MODES && radio_stats[i].mode != NULL; i++)
+    {
+        s = &radio_stats[i];
+        name = s->mode->getname(RADIO_NAME_SHORT, s->options);
+        name_len = strlen_P(name);
+
+        p = trace_reserve(TRACE_RADIO_STATS,
+                          RADIO_STATS_RECORD_LEN + name_len);
+
+        if (p == NULL)
+        {
+            return;
+        }
+
+        p = trace_put_uint(p, radio_stats_total, 4);
+        p = trace_put_uint(p, s->options, 1);
+        p = trace_put_uint(p, s->switches, 2);
+        p = trace_put_uint(p, s->bytes, 4);
+
+        for (j = 0; j < RADIO_STATS_PHASES; j++)
+        {
+            p = trace_put_uint(p, s->time[j], 4);
+        }
+
+        memcpy_P(p, name, name_len);
+        trace_commit(p - RADIO_STATS_RECORD_LEN);
+    }
 }
+
+#endif
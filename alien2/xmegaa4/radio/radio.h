@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <avr/pgmspace.h>
 #include "../data.h"
+#include "../debug/debug.h"
 
 #define RADIO_INTERRUPT_OK       0
 #define RADIO_INTERRUPT_FINISHED 1
@@ -34,31 +35,42 @@
 typedef void (*radio_initialise_function)();
 typedef uint8_t (*radio_interrupt_function)();
 typedef PGM_P (*radio_getname_function)(uint8_t t, uint8_t options);
+typedef uint32_t (*radio_airtime_function)(uint8_t options, uint16_t len);
+typedef void (*radio_refill_function)();
 
 /*
  * There are "generic continuous data modes" and "one-shot modes";
  * SSTV is, for example, an "one-shot" mode: it starts, sends a picture,
  * then stops. Other data modes are capable of sending an arbitrary stream
  * of bytes. There may be special things inside this stream, e.g. SSDV, but
- * that's handled by genericdata.c
+ * that's handled by the source (see ssdv/ssdv.h)
  */
 
+/*
+ * airtime estimates how many milliseconds it takes to send len bytes,
+ * for the scheduler. One-shot modes ignore len.
+ *
+ * refill (may be NULL) is called from the main loop, via radio_refill,
+ * after every interrupt while the mode is running; it's where a mode
+ * does slow work ahead of its ISR (e.g., radio_symbol_refill).
+ */
 struct radio_mode
 {
     radio_initialise_function init;
     radio_interrupt_function isr;
     radio_getname_function getname;
+    radio_airtime_function airtime;
+    radio_refill_function refill;
 };
 
 struct radio_state
 {
     const struct radio_mode *mode;
-    data_source source;
+    struct data_source *source;
     uint8_t options;
 };
 
 extern const struct radio_state *radio_current_state;
-#define radio_current_source (radio_current_state->source)
 #define radio_current_options (radio_current_state->options)
 
 /*
@@ -66,9 +78,29 @@ extern const struct radio_state *radio_current_state;
  * mode allocating one byte
  */
 extern uint8_t radio_data_current_byte;
-#define radio_data_update() radio_current_source(&radio_data_current_byte)
+
+/*
+ * The current state's source, which is restarted before each mode init.
+ * radio_data_update reads the next byte into radio_data_current_byte;
+ * radio_data_read reads up to len bytes into buf (see data_reader_read).
+ */
+extern struct data_reader radio_data_reader;
+
+#if DEBUG
+/* Count the bytes as well; see radio_stats in radio.c */
+uint8_t radio_data_update();
+uint16_t radio_data_read(uint8_t *buf, uint16_t len);
+#else
+#define radio_data_update() \
+    data_reader_byte(&radio_data_reader, &radio_data_current_byte)
+#define radio_data_read(buf, len) \
+    data_reader_read(&radio_data_reader, (buf), (len))
+#endif
 
 void radio_init();
 void radio_isr();
+void radio_refill();
+uint32_t radio_switch_airtime(const struct radio_state *from,
+                              const struct radio_state *to);
 
 #endif
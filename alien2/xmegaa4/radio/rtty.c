@@ -16,151 +16,245 @@
 */
 
 #include <stdint.h>
+#include <string.h>
 #include <avr/pgmspace.h>
 
 #include "radio.h"
 #include "hardware.h"
 #include "rtty.h"
 
+struct rtty_format
+{
+    uint16_t baud;
+    uint8_t data_bits;
+    uint8_t stop_halves;
+    uint16_t shift;
+};
+
 static void rtty_init();
 static uint8_t rtty_interrupt();
+static uint8_t rtty_next();
+static uint8_t rtty_encode(uint16_t *b);
 static void rtty_pause();
 static PGM_P rtty_getname(uint8_t t, uint8_t options);
+static uint32_t rtty_airtime(uint8_t options, uint16_t len);
+static void rtty_timing(const struct rtty_format *f, uint8_t *div,
+                        uint16_t *per);
+static uint8_t rtty_samples(const struct rtty_format *f);
+static uint8_t rtty_half(const struct rtty_format *f);
 
-const struct radio_mode rtty = { rtty_init, rtty_interrupt, rtty_getname };
+const struct radio_mode rtty = { rtty_init, rtty_interrupt, rtty_getname,
+                                 rtty_airtime, NULL };
 
+/*
+ * After warming up, the bits of each character are clocked out by DMA
+ * (see radio_hw_dma_start) and rtty_interrupt is only called once per
+ * character, to encode the one after next.
+ */
 #define WARM_UP    0
 #define WARMED_UP  1
-#define START_BIT  2
-#define DATA_BITS  3
-/* 8bit ascii data bits 3,4,5,6,7,8,9,10 */
-#define STOP_BIT_A 11
-#define STOP_BIT_B 12
-#define STATUS_END 13
+#define RUNNING    2
+#define DRAINING   3
 static uint8_t rtty_status;
 
+/*
+ * Each of the options is a format: baud (50 to 1200), data bits (7 or 8),
+ * stop bits in halves (2, 3 or 4) and shift (DAC steps above SPACE_VALUE;
+ * 700 is 425Hz). The timer runs at one sample per bit, or per half bit if
+ * there are 1.5 stop bits, and its period is worked out from the baud so
+ * that bits are as near exact as the prescaler allows.
+ */
 #define SPACE_VALUE 2000
-#define MARK_VALUE  2700
+
+static struct rtty_format rtty_formats[] PROGMEM =
+    { { 50, 8, 4, 700 }, { 300, 8, 4, 700 }, { 50, 7, 4, 700 },
+      { 50, 7, 2, 700 }, { 100, 8, 3, 700 } };
+
+static char rtty_short_names[][11] PROGMEM =
+    { "RTTY50", "RTTY300", "RTTY50/7", "RTTY50/7n1", "RTTY100" };
+static char rtty_long_names[][19] PROGMEM =
+    { "RTTY 50 425 8n2", "RTTY 300 425 8n2", "RTTY 50 425 7n2",
+      "RTTY 50 425 7n1", "RTTY 100 425 8n1.5" };
+
+/* The current format, copied out of flash by rtty_init */
+static struct rtty_format rtty_format;
+static uint16_t rtty_mark;
+static uint8_t rtty_div;
+static uint16_t rtty_per;
+
+/* rtty_pause, before and after */
+#define RTTY_PAUSE_MS 500
 
 static void rtty_init()
 {
+    memcpy_P(&rtty_format, &(rtty_formats[radio_current_options]),
+             sizeof(rtty_format));
+    rtty_mark = SPACE_VALUE + rtty_format.shift;
+    rtty_timing(&rtty_format, &rtty_div, &rtty_per);
+
     radio_hw_mode(RADIO_HW_MODE_TX);
-    radio_hw_dac_set(MARK_VALUE);
+    radio_hw_dac_set(rtty_mark);
     rtty_pause();
 
     radio_data_update();
     rtty_status = WARM_UP;
 }
 
-#define SPACE 0
-#define MARK  1
-
 static uint8_t rtty_interrupt()
 {
-    uint8_t bit;
-
     if (rtty_status == WARM_UP)
     {
-        bit = MARK;
+        rtty_status = WARMED_UP;
+        return RADIO_INTERRUPT_OK;
     }
     else if (rtty_status == WARMED_UP)
     {
-        if (radio_current_options == RTTY_SLOW)
-        {
-            radio_hw_timer_set(RADIO_HW_TIMER_DIV4, 40000);
-        }
-        else
-        {
-            radio_hw_timer_set(RADIO_HW_TIMER_DIV1, 26667);
-        }
+        /*
+         * The DAC holds MARK until the first event, so the first character
+         * is preceded by one more sample of MARK.
+         */
+        radio_hw_dma_start(rtty_div, rtty_per);
 
-        bit = MARK;
+        /* rtty_init fetched the first byte */
+        radio_hw_dma_queue(rtty_encode(radio_hw_dma_buffer()));
+        rtty_status = RUNNING;
     }
-    else if (rtty_status == START_BIT)
+
+    return rtty_next();
+}
+
+static uint8_t rtty_next()
+{
+    if (rtty_status == RUNNING)
     {
-        bit = SPACE;
+        if (radio_data_update() == DATA_SOURCE_OK)
+        {
+            radio_hw_dma_queue(rtty_encode(radio_hw_dma_buffer()));
+            return RADIO_INTERRUPT_OK;
+        }
+
+        rtty_status = DRAINING;
     }
-    else if (rtty_status == STOP_BIT_A || rtty_status == STOP_BIT_B)
+
+    if (radio_hw_dma_drain() == RADIO_HW_DMA_BUSY)
     {
-        bit = MARK;
+        return RADIO_INTERRUPT_OK;
     }
-    else
+
+    rtty_pause();
+    return RADIO_INTERRUPT_FINISHED;
+}
+
+/* Start bit, data bits LSB first, stop bits */
+static uint8_t rtty_encode(uint16_t *b)
+{
+    uint8_t i, j, n, c, half;
+    uint16_t value;
+
+    c = radio_data_current_byte;
+    half = rtty_half(&rtty_format);
+    value = SPACE_VALUE;
+    n = 0;
+
+    for (i = 0; i <= rtty_format.data_bits; i++)
     {
-        uint8_t mask;
-        mask = (1 << (rtty_status - (DATA_BITS)));
+        for (j = 0; j < half; j++)
+        {
+            b[n] = value;
+            n++;
+        }
 
-        if (radio_data_current_byte & mask)
+        if (c & 0x01)
         {
-            bit = MARK;
+            value = rtty_mark;
         }
         else
         {
-            bit = SPACE;
+            value = SPACE_VALUE;
         }
-    }
 
-    if (bit == SPACE)
-    {
-        radio_hw_dac_set(SPACE_VALUE);
+        c >>= 1;
     }
-    else
+
+    for (i = 0; i < rtty_format.stop_halves * half / 2; i++)
     {
-        radio_hw_dac_set(MARK_VALUE);
+        b[n] = rtty_mark;
+        n++;
     }
 
-    rtty_status++;
+    return n;
+}
 
-    if (rtty_status >= STATUS_END)
-    {
-        uint8_t source_status;
-        source_status = radio_data_update();
+static void rtty_pause()
+{
+    radio_hw_timer_set(RADIO_HW_TIMER_DIV256, 15625);
+}
 
-        if (source_status == DATA_SOURCE_FINISHED)
-        {
-            rtty_pause();
-            return RADIO_INTERRUPT_FINISHED;
-        }
-        else
+/* Samples per bit: 2 if there are 1.5 stop bits */
+static uint8_t rtty_half(const struct rtty_format *f)
+{
+    return (f->stop_halves & 1) + 1;
+}
+
+/* Samples per character */
+static uint8_t rtty_samples(const struct rtty_format *f)
+{
+    return (f->data_bits + 1) * rtty_half(f) +
+           f->stop_halves * rtty_half(f) / 2;
+}
+
+/*
+ * The smallest prescaler (of DIV1 to DIV8, which are consecutive and
+ * enough down to 16 baud) that fits the sample period, rounded to the
+ * nearest tick. A period is per + 1 ticks.
+ */
+static void rtty_timing(const struct rtty_format *f, uint8_t *div,
+                        uint16_t *per)
+{
+    uint32_t rate, ticks;
+    uint8_t shift;
+
+    rate = (uint32_t) f->baud * rtty_half(f);
+
+    for (shift = 0; shift < 3; shift++)
+    {
+        if (F_CPU / (rate << shift) <= 65536)
         {
-            rtty_status = START_BIT;
+            break;
         }
     }
 
-    return RADIO_INTERRUPT_OK;
+    ticks = (F_CPU + ((rate << shift) / 2)) / (rate << shift);
+    *div = RADIO_HW_TIMER_DIV1 + shift;
+    *per = ticks - 1;
 }
 
-static void rtty_pause()
+/* Warm up, the extra sample of MARK, the characters, then the last pause */
+static uint32_t rtty_airtime(uint8_t options, uint16_t len)
 {
-    radio_hw_timer_set(RADIO_HW_TIMER_DIV256, 15625);
-}
+    struct rtty_format f;
+    uint32_t samples;
+    uint16_t per;
+    uint8_t div;
+
+    memcpy_P(&f, &(rtty_formats[options]), sizeof(f));
+    rtty_timing(&f, &div, &per);
+    samples = ((uint32_t) len * rtty_samples(&f)) + 1;
 
-static char rtty_slow_short_name[] PROGMEM = "RTTY50";
-static char rtty_slow_long_name[] PROGMEM = "RTTY 50 425 8n2";
-static char rtty_fast_short_name[] PROGMEM = "RTTY300";
-static char rtty_fast_long_name[] PROGMEM = "RTTY 300 425 8n2";
+    /* DIV1 is 1, DIV2 is 2, e.t.c. */
+    return (2 * RTTY_PAUSE_MS) +
+           ((samples * (((uint32_t) per + 1) << (div - RADIO_HW_TIMER_DIV1)))
+            / (F_CPU / 1000));
+}
 
 static PGM_P rtty_getname(uint8_t t, uint8_t options)
 {
     if (t == RADIO_NAME_SHORT)
     {
-        if (options == RTTY_SLOW)
-        {
-            return rtty_slow_short_name;
-        }
-        else
-        {
-            return rtty_fast_short_name;
-        }
+        return rtty_short_names[options];
     }
     else
     {
-        if (options == RTTY_SLOW)
-        {
-            return rtty_slow_long_name;
-        }
-        else
-        {
-            return rtty_fast_long_name;
-        }
+        return rtty_long_names[options];
     }
 }
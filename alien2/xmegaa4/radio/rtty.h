@@ -20,8 +20,12 @@
 
 #include "radio.h"
 
-#define RTTY_SLOW 0
-#define RTTY_FAST 1
+/* Formats (options); see rtty.c */
+#define RTTY_SLOW     0  /* 50 baud 8n2 */
+#define RTTY_FAST     1  /* 300 baud 8n2 */
+#define RTTY_50_7N2   2
+#define RTTY_50_7N1   3
+#define RTTY_100_8N15 4
 
 extern const struct radio_mode rtty;
 
@@ -20,44 +20,121 @@
 
 #include "../util.h"
 #include "../data.h"
+#include "../telem/telem.h"
+#include "../ssdv/ssdv.h"
 
 #include "radio.h"
 #include "sched.h"
 
 #include "domex.h"
 #include "rtty.h"
+#include "thor.h"
 #include "uplink.h"
 
 /* Testing */
+#include "../test.h"
+#include "aprs.h"
 #include "hell.h"
 #include "morse.h"
-#include "../test.h"
+#include "sstv.h"
 
-struct radio_rotation_item
+/*
+ * Each item in the rotation is a source, sent in some mode, that is given
+ * share parts of the airtime; items queued with radio_queue_add share
+ * SCHED_QUEUE_SHARE parts between them. The airtime of an item is
+ * estimated from its mode (see struct radio_mode) and the length of its
+ * payload, plus the time radio.c spends switching to it from the
+ * previous item (announce and delays; see radio_switch_airtime).
+ *
+ * Every time an item is picked, its estimate divided by its share is
+ * added to its "virtual time", and the item that is furthest behind
+ * (lowest virtual time) goes next. Whatever the shares, a position report
+ * is forced if the next item would leave more than SCHED_MAX_GAP_MS
+ * between the end of one position report and the start of the next;
+ * unless one has just been sent, so that items longer than that still
+ * get their turn.
+ *
+ * A SCHED_ADAPTIVE item isn't sent in its own settings but in those of
+ * adaptive_states for the current uplink_link (see uplink.c): the faster
+ * the better the link is, and the slower and more robust at long range.
+ * Its length function must suit all of them. radio.c announces a change
+ * of mode as usual.
+ */
+struct radio_sched_item
 {
     const struct radio_state settings;
-    uint8_t reps;
+    uint16_t (*length)();  /* NULL for one-shot modes */
+    uint8_t share;
+    uint8_t flags;
 };
 
-#define default_source test_source /* Testing */ /* telem_get_byte */
-#define rotation_len 2 /* Testing */ /* 3 */
-static struct radio_rotation_item rotation[rotation_len] =
-/*    { { { &domex, default_source, 0 }, 2 }, */
-      { { { &rtty, default_source, 0 }, 1 },
-/* Not yet implemented */
-      { { &uplink, NULL, 0 }, 1 } };
+#define SCHED_POSITION     0x01  /* item is a position report */
+#define SCHED_ADAPTIVE     0x02  /* see adaptive_states */
+
+#define SCHED_MAX_GAP_MS   60000UL
+#define SCHED_QUEUE_SHARE  4
+
+/*
+ * Image packets with a position report in front, all in one mode (so
+ * without announcing and delays in between). A fresh position report goes
+ * first even if it was rendered after the item started.
+ */
+#define DOWNLINK_PACKETS 4
+static const struct data_mux_input downlink_inputs[] =
+    { { &telem_source.source, telem_fresh, telem_length, DATA_MUX_ONCE },
+      { &ssdv_source, ssdv_fresh, ssdv_length, 0 } };
+static struct data_mux downlink =
+    DATA_MUX(downlink_inputs, 2, DOWNLINK_PACKETS);
+
+static uint16_t downlink_length();
+
+#define default_source (&telem_source.source)
+
+/*
+ * Indexed by uplink_link, POOR to GOOD: DominoEX, which stays decodable
+ * furthest out, RTTY50 and RTTY300. THOR_16 would do better still on a
+ * poor link, once thor_varicode.h has been generated (see thor.c).
+ */
+static const struct radio_state adaptive_states[UPLINK_LINKS] =
+    { { &domex, default_source, 0 },
+      { &rtty, default_source, RTTY_SLOW },
+      { &rtty, default_source, RTTY_FAST } };
+
+#define rotation_len 3 /* Testing */ /* 4 */
+static struct radio_sched_item rotation[rotation_len] =
+/*    { { { &domex, default_source, 0 }, telem_length, 4, SCHED_POSITION }, */
+      { { { &rtty, default_source, 0 }, telem_length, 3,
+          SCHED_POSITION | SCHED_ADAPTIVE },
+      { { &rtty, &downlink.source, RTTY_FAST }, downlink_length, 2,
+        SCHED_POSITION },
+      { { &uplink, NULL, 0 }, NULL, 1, 0 } };
 /* Testing: *
-      { { &hell, default_source, 0 }, 1 },
-      { { &rtty, default_source, 1 }, 2 },
-      { { &morse, default_source, 0 }, 1 } }; */
+      { { &domex, &ssdv_source, 0 }, ssdv_length, 2, 0 },
+      { { &thor, default_source, THOR_16 }, telem_length, 2, SCHED_POSITION },
+      { { &aprs, &telem_status.source, 0 }, telem_status_length, 2,
+        SCHED_POSITION },
+      { { &hell, default_source, 0 }, telem_length, 1, SCHED_POSITION },
+      { { &rtty, default_source, 1 }, telem_length, 2, SCHED_POSITION },
+      { { &morse, default_source, 0 }, telem_length, 1, SCHED_POSITION },
+      { { &rtty, &test_twice.source, 1 }, test_twice_length, 1, 0 },
+      { { &sstv, &test_image_source, 0 }, NULL, 1, 0 } };
+*/
 
-#define TYPE_NONE     0
-#define TYPE_ROTATION 1
-#define TYPE_QUEUE    2
+/* The queue is item number rotation_len */
+#define ITEM_QUEUE rotation_len
+#define ITEM_NONE  0xFF
 
-static uint8_t rotation_item, rotation_reps, current_type;
+static uint32_t vtime[rotation_len + 1];
+static uint32_t position_gap;
+static uint8_t current_item = ITEM_NONE;
 static struct radio_queue_item *queue_item, *queue_last_item;
 
+static const struct radio_state *sched_state(uint8_t i);
+static uint32_t sched_airtime(uint8_t i);
+static uint8_t sched_share(uint8_t i);
+static uint8_t sched_pick(uint8_t flags);
+static void sched_normalise();
+
 void radio_queue_add(struct radio_queue_item *item)
 {
     if (item->next != NULL)
@@ -79,39 +156,179 @@ void radio_queue_add(struct radio_queue_item *item)
 
 const struct radio_state *radio_sched_get()
 {
-    /* Dispose of the current item / update the current item */
-    if (current_type == TYPE_ROTATION)
-    {
-        rotation_reps++;
+    const struct radio_state *previous;
+    uint8_t item, position;
+    uint32_t t;
 
-        if (rotation_reps >= rotation[rotation_item].reps)
-        {
-            rotation_reps = 0;
-            rotation_item++;
+    previous = NULL;
 
-            if (rotation_item >= rotation_len)
-            {
-                rotation_item = 0;
-            }
-        }
-    }
-    else if (current_type == TYPE_QUEUE)
+    /* Dispose of the current item */
+    if (current_item == ITEM_QUEUE)
     {
         struct radio_queue_item *old_item;
         old_item = queue_item;
         queue_item = queue_item->next;
         old_item->next = NULL; /* signals completion */
+
+        previous = &(old_item->settings);
+    }
+    else if (current_item != ITEM_NONE)
+    {
+        previous = sched_state(current_item);
+    }
+
+    item = sched_pick(0);
+    t = radio_switch_airtime(previous, sched_state(item)) +
+        sched_airtime(item);
+
+    /* Would a position report be too late if we sent this first? */
+    if (item == ITEM_QUEUE || !(rotation[item].flags & SCHED_POSITION))
+    {
+        position = sched_pick(SCHED_POSITION);
+
+        if (position != ITEM_NONE && position_gap != 0 &&
+            position_gap + t +
+            radio_switch_airtime(sched_state(item),
+                                 sched_state(position)) > SCHED_MAX_GAP_MS)
+        {
+            item = position;
+            t = radio_switch_airtime(previous, sched_state(item)) +
+                sched_airtime(item);
+        }
+    }
+
+    if (item != ITEM_QUEUE && (rotation[item].flags & SCHED_POSITION))
+    {
+        position_gap = 0;
     }
+    else
+    {
+        position_gap += t;
+    }
+
+    vtime[item] += t / sched_share(item);
+    sched_normalise();
+
+    current_item = item;
+    return sched_state(item);
+}
 
-    /* Return the new item */
-    if (queue_item != NULL)
+static uint16_t downlink_length()
+{
+    return data_mux_length(&downlink);
+}
+
+static const struct radio_state *sched_state(uint8_t i)
+{
+    if (i == ITEM_QUEUE)
     {
-        current_type = TYPE_QUEUE;
         return &(queue_item->settings);
     }
+    else if (rotation[i].flags & SCHED_ADAPTIVE)
+    {
+        return &(adaptive_states[uplink_link]);
+    }
+    else
+    {
+        return &(rotation[i].settings);
+    }
+}
+
+static uint32_t sched_airtime(uint8_t i)
+{
+    const struct radio_state *state;
+    uint16_t len;
+
+    state = sched_state(i);
+
+    if (i == ITEM_QUEUE)
+    {
+        len = queue_item->len;
+    }
+    else if (rotation[i].length != NULL)
+    {
+        len = rotation[i].length();
+    }
+    else
+    {
+        len = 0;
+    }
+
+    return state->mode->airtime(state->options, len);
+}
+
+static uint8_t sched_share(uint8_t i)
+{
+    if (i == ITEM_QUEUE)
+    {
+        return SCHED_QUEUE_SHARE;
+    }
+    else
+    {
+        return rotation[i].share;
+    }
+}
+
+/*
+ * The item with the lowest vtime that has all of flags; the queue only
+ * counts if it isn't empty and no flags are asked for, and wins a tie (it
+ * starts level with the furthest behind item; see sched_normalise).
+ */
+static uint8_t sched_pick(uint8_t flags)
+{
+    uint8_t i, best;
+
+    best = ITEM_NONE;
+
+    for (i = 0; i < rotation_len; i++)
+    {
+        if ((rotation[i].flags & flags) == flags &&
+            (best == ITEM_NONE || vtime[i] < vtime[best]))
+        {
+            best = i;
+        }
+    }
+
+    if (queue_item != NULL && flags == 0 &&
+        (best == ITEM_NONE || vtime[ITEM_QUEUE] <= vtime[best]))
+    {
+        best = ITEM_QUEUE;
+    }
+
+    return best;
+}
+
+/*
+ * Keep vtimes small by subtracting the lowest from all of them. An empty
+ * queue doesn't bank time: something added to it later starts level with
+ * the furthest behind item.
+ */
+static void sched_normalise()
+{
+    uint8_t i;
+    uint32_t min;
+
+    min = vtime[0];
+
+    for (i = 1; i < rotation_len; i++)
+    {
+        if (vtime[i] < min)
+        {
+            min = vtime[i];
+        }
+    }
+
+    for (i = 0; i < rotation_len; i++)
+    {
+        vtime[i] -= min;
+    }
+
+    if (queue_item == NULL || vtime[ITEM_QUEUE] < min)
+    {
+        vtime[ITEM_QUEUE] = 0;
+    }
     else
     {
-        current_type = TYPE_ROTATION;
-        return &(rotation[rotation_item].settings);
+        vtime[ITEM_QUEUE] -= min;
     }
 }
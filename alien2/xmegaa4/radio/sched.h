@@ -22,11 +22,13 @@
 
 /*
  * We force anything that uses queue_add to statically allocate its own memory
- * for the item so that we don't have to use dynamic memory
+ * for the item so that we don't have to use dynamic memory. len is how many
+ * bytes settings.source will produce, for the airtime estimate.
  */
 struct radio_queue_item
 {
     struct radio_state settings;
+    uint16_t len;
     struct radio_queue_item *next;
 };
 
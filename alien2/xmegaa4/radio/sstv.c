@@ -16,6 +16,8 @@
 */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <avr/pgmspace.h>
 
 #include "radio.h"
@@ -24,19 +26,375 @@
 
 static void sstv_init();
 static uint8_t sstv_interrupt();
+static void sstv_refill();
 static PGM_P sstv_getname(uint8_t t, uint8_t options);
+static uint32_t sstv_airtime(uint8_t options, uint16_t len);
+static uint8_t sstv_encode(uint16_t *b);
+static uint16_t sstv_next_sample();
+static uint8_t sstv_next_segment();
+static uint16_t sstv_vis(uint16_t *ms);
+static void sstv_scan_start();
 
-const struct radio_mode sstv = { sstv_init, sstv_interrupt, sstv_getname };
+const struct radio_mode sstv = { sstv_init, sstv_interrupt, sstv_getname,
+                                 sstv_airtime, sstv_refill };
+
+/*
+ * Martin M1: after the VIS header, 256 lines of
+ *
+ *   sync (1200Hz, 4.862ms), porch (1500Hz, 0.572ms),
+ *   green, separator, blue, separator, red, separator
+ *
+ * where each scan is 320 pixels of 0.4576ms (1500Hz black to 2300Hz white)
+ * and each separator is 1500Hz for 0.572ms; 446.446ms in all.
+ *
+ * Samples are clocked out by DMA (see radio_hw_dma_start), one per pixel,
+ * and sstv_interrupt is called once per RADIO_HW_DMA_BUFFER_LEN of them to
+ * fill the next buffer. A pixel is 3660.8 CPU cycles, so the sample clock
+ * is 3661 (55ppm slow). Every segment ends at its exact time (to the
+ * nearest sample, after) so that the error doesn't add up: it is taken
+ * out of the syncs and porches, which get the odd sample more or less,
+ * and lines come at exactly 446.446ms.
+ *
+ * The image comes from the current source: one byte per pixel, in the
+ * order that they're sent (i.e., each line is green, blue, red). Scans are
+ * read into two buffers by sstv_refill, from the main loop, ahead of being
+ * needed. If one isn't ready in time it's sent black.
+ */
+#define SSTV_WIDTH          320
+#define SSTV_LINES          256
+#define SSTV_SCANS          (SSTV_LINES * 3)
+
+#define SSTV_SAMPLE_PER     3660
+#define SSTV_SAMPLE_CYCLES  (SSTV_SAMPLE_PER + 1UL)
+#define SSTV_CYCLES(us)     ((uint32_t) (us) * (F_CPU / 1000000))
+
+#define SSTV_SYNC_US        4862
+#define SSTV_PORCH_US       572
+#define SSTV_SCAN_US        146432
+#define SSTV_VIS_CODE       44
+#define SSTV_DONE           0xFFFF
+
+/*
+ * The DAC moves the carrier by about 0.6Hz per step (cf. DominoEX's
+ * TONE_SHIFT, which is its 21.5Hz tone spacing), so 800Hz of pixel range
+ * is 1333 steps. 1900Hz (the VIS leader) is put mid scale.
+ */
+#define SSTV_DAC(hz)        (2048 + ((((hz) - 1900) * 5) / 3))
+#define SSTV_BLACK          SSTV_DAC(1500)
+
+/* value * 5.23 */
+#define sstv_pixel(value)   (SSTV_BLACK + ((value) * 5) + \
+                             (((value) * 59) >> 8))
+
+/* A Martin M1 frame, VIS header included */
+#define SSTV_AIRTIME_MS 115200
+
+#define STATUS_VIS      0
+#define STATUS_LINES    1
+#define STATUS_DONE     2
+
+/* Segments of the VIS header */
+#define VIS_START       3
+#define VIS_PARITY      11
+#define VIS_STOP        12
+
+/* Segments of a line */
+#define SEG_SYNC        0
+#define SEG_PORCH       1
+#define SEG_GREEN       2
+#define SEG_SEP_G       3
+#define SEG_BLUE        4
+#define SEG_SEP_B       5
+#define SEG_RED         6
+#define SEG_SEP_R       7
+#define SEG_END         8
+
+static uint8_t sstv_status, sstv_segment, sstv_draining;
+static uint16_t sstv_line, sstv_x, sstv_value;
+static uint32_t sstv_time, sstv_end;
+static uint8_t *sstv_scan;
+
+/*
+ * Scan n goes in sstv_buffer[n & 1]. sstv_filled and sstv_played count
+ * scans modulo 256; they are written by sstv_refill and the ISR
+ * respectively.
+ */
+static uint8_t sstv_buffer[2][SSTV_WIDTH];
+static volatile uint8_t sstv_filled, sstv_played;
+static uint16_t sstv_fill_scans;
+static uint8_t sstv_source_done;
 
 static void sstv_init()
 {
-    /* TODO */
+    uint16_t ms;
+
+    sstv_status = STATUS_VIS;
+    sstv_segment = 0;
+    sstv_time = 0;
+    sstv_scan = NULL;
+    sstv_draining = 0;
+
+    sstv_filled = 0;
+    sstv_played = 0;
+    sstv_fill_scans = 0;
+    sstv_source_done = 0;
+
+    /* The leader goes out until the first sample, too */
+    sstv_value = sstv_vis(&ms);
+    sstv_end = SSTV_CYCLES(ms * 1000UL);
+
+    radio_hw_mode(RADIO_HW_MODE_TX);
+    radio_hw_dac_set(sstv_value);
+    radio_hw_dma_start(RADIO_HW_TIMER_DIV1, SSTV_SAMPLE_PER);
+
+    /* radio_isr calls sstv_interrupt straight after this, for the second */
+    radio_hw_dma_queue(sstv_encode(radio_hw_dma_buffer()));
 }
 
 static uint8_t sstv_interrupt()
 {
-    /* TODO */
-    return RADIO_INTERRUPT_FINISHED;
+    uint8_t n;
+
+    if (!sstv_draining)
+    {
+        n = sstv_encode(radio_hw_dma_buffer());
+
+        if (n != 0)
+        {
+            radio_hw_dma_queue(n);
+            return RADIO_INTERRUPT_OK;
+        }
+
+        sstv_draining = 1;
+    }
+
+    return radio_hw_dma_drain();
+}
+
+static void sstv_refill()
+{
+    uint8_t *b;
+    uint16_t n;
+
+    while (sstv_fill_scans < SSTV_SCANS &&
+           (int8_t) (sstv_filled - sstv_played) < 2)
+    {
+        /* If we're behind, the ISR has sent this one black already */
+        if ((int8_t) (sstv_filled - sstv_played) < 0)
+        {
+            b = NULL;
+        }
+        else
+        {
+            b = sstv_buffer[sstv_filled & 1];
+        }
+
+        n = 0;
+
+        if (!sstv_source_done)
+        {
+            n = radio_data_read(b, SSTV_WIDTH);
+
+            if (n != SSTV_WIDTH)
+            {
+                sstv_source_done = 1;
+            }
+        }
+
+        if (b != NULL)
+        {
+            memset(b + n, 0, SSTV_WIDTH - n);
+        }
+
+        sstv_fill_scans++;
+        sstv_filled++;
+    }
+}
+
+static uint8_t sstv_encode(uint16_t *b)
+{
+    uint16_t value;
+    uint8_t n;
+
+    for (n = 0; n < RADIO_HW_DMA_BUFFER_LEN; n++)
+    {
+        value = sstv_next_sample();
+
+        if (value == SSTV_DONE)
+        {
+            break;
+        }
+
+        b[n] = value;
+    }
+
+    return n;
+}
+
+static uint16_t sstv_next_sample()
+{
+    uint16_t value;
+
+    while (sstv_scan == NULL && sstv_time >= sstv_end)
+    {
+        if (!sstv_next_segment())
+        {
+            return SSTV_DONE;
+        }
+    }
+
+    if (sstv_scan != NULL)
+    {
+        value = sstv_pixel(sstv_scan[sstv_x]);
+        sstv_x++;
+
+        if (sstv_x == SSTV_WIDTH)
+        {
+            sstv_scan = NULL;
+            sstv_played++;
+        }
+    }
+    else
+    {
+        value = sstv_value;
+    }
+
+    sstv_time += SSTV_SAMPLE_CYCLES;
+    return value;
+}
+
+/* Moves sstv_end on to the end of the next segment; 0 if there isn't one */
+static uint8_t sstv_next_segment()
+{
+    uint16_t ms;
+    uint32_t us;
+
+    if (sstv_status == STATUS_DONE)
+    {
+        return 0;
+    }
+
+    sstv_segment++;
+
+    if (sstv_status == STATUS_VIS)
+    {
+        if (sstv_segment <= VIS_STOP)
+        {
+            sstv_value = sstv_vis(&ms);
+            sstv_end += SSTV_CYCLES(ms * 1000UL);
+            return 1;
+        }
+
+        sstv_status = STATUS_LINES;
+        sstv_segment = SEG_SYNC;
+        sstv_line = 0;
+    }
+    else if (sstv_segment == SEG_END)
+    {
+        sstv_segment = SEG_SYNC;
+        sstv_line++;
+
+        if (sstv_line == SSTV_LINES)
+        {
+            sstv_status = STATUS_DONE;
+            return 0;
+        }
+    }
+
+    switch (sstv_segment)
+    {
+        case SEG_SYNC:
+            sstv_value = SSTV_DAC(1200);
+            us = SSTV_SYNC_US;
+            break;
+
+        case SEG_GREEN:
+        case SEG_BLUE:
+        case SEG_RED:
+            sstv_scan_start();
+            us = SSTV_SCAN_US;
+            break;
+
+        default:
+            sstv_value = SSTV_BLACK;
+            us = SSTV_PORCH_US;
+            break;
+    }
+
+    sstv_end += SSTV_CYCLES(us);
+    return 1;
+}
+
+/*
+ * The VIS header: 1900Hz leader (300ms), 1200Hz break (10ms), leader,
+ * then 30ms each of a 1200Hz start bit, the seven bit code LSB first and
+ * even parity (1100Hz for a 1, 1300Hz for a 0) and a 1200Hz stop bit.
+ */
+static uint16_t sstv_vis(uint16_t *ms)
+{
+    uint8_t code, bit, ones;
+
+    *ms = 30;
+
+    switch (sstv_segment)
+    {
+        case 0:
+        case 2:
+            *ms = 300;
+            return SSTV_DAC(1900);
+
+        case 1:
+            *ms = 10;
+            return SSTV_DAC(1200);
+
+        case VIS_START:
+        case VIS_STOP:
+            return SSTV_DAC(1200);
+
+        case VIS_PARITY:
+            ones = 0;
+
+            for (code = SSTV_VIS_CODE; code != 0; code >>= 1)
+            {
+                ones += code & 0x01;
+            }
+
+            bit = ones & 0x01;
+            break;
+
+        default:
+            bit = (SSTV_VIS_CODE >> (sstv_segment - VIS_START - 1)) & 0x01;
+            break;
+    }
+
+    if (bit)
+    {
+        return SSTV_DAC(1100);
+    }
+    else
+    {
+        return SSTV_DAC(1300);
+    }
+}
+
+static void sstv_scan_start()
+{
+    if (sstv_filled == sstv_played)
+    {
+        /* sstv_refill hasn't got to it: send it black */
+        debug_es("SSTV underrun\n");
+        sstv_played++;
+        sstv_value = SSTV_BLACK;
+        return;
+    }
+
+    sstv_scan = sstv_buffer[sstv_played & 1];
+    sstv_x = 0;
+}
+
+static uint32_t sstv_airtime(uint8_t options, uint16_t len)
+{
+    return SSTV_AIRTIME_MS;
 }
 
 static char sstv_short_name[] PROGMEM = "SSTV";
@@ -0,0 +1,162 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../data.h"
+#include "../debug/debug.h"
+#include "radio.h"
+#include "hardware.h"
+#include "symbol.h"
+
+/*
+ * The main loop (via radio_symbol_refill) is the only writer of
+ * radio_symbol_head and radio_symbol_status, and radio_symbol_isr the only
+ * writer of radio_symbol_tail. Indices are free running; a power of two
+ * FIFO length lets them wrap. The mode can't finish (and so another can't
+ * be started) until the encoder has returned DATA_SOURCE_FINISHED, so the
+ * main loop is never part way through an encoder that has been replaced.
+ *
+ * A symbol's period has to be in PERBUF before the overflow that starts
+ * it. "armed" means that's been done for the symbol at the tail. If it
+ * hasn't (the FIFO ran dry), the current symbol is stretched by a period
+ * while we catch up.
+ */
+#define RADIO_SYMBOL_FIFO_LEN   16
+#define RADIO_SYMBOL_FIFO_MASK  (RADIO_SYMBOL_FIFO_LEN - 1)
+
+#define SYMBOL_ENCODING  0
+#define SYMBOL_ENDED     1
+
+#define KEYED_OFF        0
+#define KEYED_ON         1
+#define KEYED_UNKNOWN    2
+
+static struct radio_symbol radio_symbol_fifo[RADIO_SYMBOL_FIFO_LEN];
+static volatile uint8_t radio_symbol_head, radio_symbol_tail;
+static volatile uint8_t radio_symbol_status = SYMBOL_ENDED;
+static uint8_t radio_symbol_armed, radio_symbol_keyed;
+static radio_encode_function radio_symbol_encode;
+
+static void radio_symbol_apply(uint16_t value);
+static void radio_symbol_arm();
+
+void radio_symbol_start(uint8_t div, radio_encode_function encode)
+{
+    struct radio_symbol *s;
+
+    radio_symbol_encode = encode;
+    radio_symbol_head = radio_symbol_tail;
+    radio_symbol_status = SYMBOL_ENCODING;
+    radio_symbol_keyed = KEYED_UNKNOWN;
+    radio_symbol_refill();
+
+    if (radio_symbol_head == radio_symbol_tail)
+    {
+        /* Nothing to send: radio_symbol_isr will finish after a period */
+        radio_symbol_apply(RADIO_SYMBOL_TXOFF);
+        radio_hw_timer_set(div, 0xFFFF);
+        radio_symbol_armed = 0;
+        return;
+    }
+
+    s = &radio_symbol_fifo[radio_symbol_tail & RADIO_SYMBOL_FIFO_MASK];
+    radio_symbol_apply(s->value);
+    radio_hw_timer_set(div, s->per);
+    radio_symbol_tail++;
+    radio_symbol_arm();
+}
+
+uint8_t radio_symbol_isr()
+{
+    if (radio_symbol_armed)
+    {
+        radio_symbol_apply(radio_symbol_fifo[radio_symbol_tail &
+                                             RADIO_SYMBOL_FIFO_MASK].value);
+        radio_symbol_tail++;
+        radio_symbol_arm();
+        return RADIO_INTERRUPT_OK;
+    }
+
+    if (radio_symbol_head == radio_symbol_tail &&
+        radio_symbol_status == SYMBOL_ENDED)
+    {
+        return RADIO_INTERRUPT_FINISHED;
+    }
+
+    debug_es("Symbol FIFO underrun\n");
+    radio_symbol_arm();
+    return RADIO_INTERRUPT_OK;
+}
+
+void radio_symbol_refill()
+{
+    struct radio_symbol *s;
+
+    while (radio_symbol_status == SYMBOL_ENCODING &&
+           (uint8_t) (radio_symbol_head - radio_symbol_tail) <
+           RADIO_SYMBOL_FIFO_LEN)
+    {
+        s = &radio_symbol_fifo[radio_symbol_head & RADIO_SYMBOL_FIFO_MASK];
+
+        if (radio_symbol_encode(s) == DATA_SOURCE_OK)
+        {
+            radio_symbol_head++;
+        }
+        else
+        {
+            radio_symbol_status = SYMBOL_ENDED;
+        }
+    }
+}
+
+static void radio_symbol_apply(uint16_t value)
+{
+    if (value == RADIO_SYMBOL_TXOFF)
+    {
+        if (radio_symbol_keyed != KEYED_OFF)
+        {
+            radio_hw_mode(RADIO_HW_MODE_TXOFF);
+            radio_symbol_keyed = KEYED_OFF;
+        }
+    }
+    else
+    {
+        radio_hw_dac_set(value);
+
+        if (radio_symbol_keyed != KEYED_ON)
+        {
+            radio_hw_mode(RADIO_HW_MODE_TX);
+            radio_symbol_keyed = KEYED_ON;
+        }
+    }
+}
+
+static void radio_symbol_arm()
+{
+    if (radio_symbol_head != radio_symbol_tail)
+    {
+        radio_hw_queue_period_update(
+            radio_symbol_fifo[radio_symbol_tail & RADIO_SYMBOL_FIFO_MASK].per);
+        radio_symbol_armed = 1;
+    }
+    else
+    {
+        radio_symbol_armed = 0;
+    }
+}
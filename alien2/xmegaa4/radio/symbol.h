@@ -0,0 +1,61 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RADIO_SYMBOL_H__
+#define __RADIO_SYMBOL_H__
+
+#include <stdint.h>
+#include "radio.h"
+
+/*
+ * Symbol FIFO: a mode that is just a sequence of DAC values (or silences)
+ * of varying length can be written as an encoder, which is run from the
+ * main loop (radio_symbol_refill is the mode's refill) to keep a FIFO of
+ * upcoming symbols topped up, and radio_symbol_isr, which is the mode's
+ * isr and only pops and applies them. Table lookups and data_source calls
+ * happen in the encoder, so the high level ISR takes the same (short) time
+ * whatever the mode.
+ *
+ * per is the TCC0 period (see radio_hw_timer_set) for which the symbol is
+ * output. value is a DAC value, or RADIO_SYMBOL_TXOFF.
+ */
+#define RADIO_SYMBOL_TXOFF 0xFFFF
+
+struct radio_symbol
+{
+    uint16_t value;
+    uint16_t per;
+};
+
+/*
+ * Writes the next symbol to s and returns DATA_SOURCE_OK, or returns
+ * DATA_SOURCE_FINISHED if there are no more (usually because
+ * radio_data_update did).
+ */
+typedef uint8_t (*radio_encode_function)(struct radio_symbol *s);
+
+/*
+ * Call from the mode's init: fills the FIFO and outputs the first symbol
+ * straight away, with the timer prescaler div.
+ */
+void radio_symbol_start(uint8_t div, radio_encode_function encode);
+uint8_t radio_symbol_isr();
+
+/* The mode's refill */
+void radio_symbol_refill();
+
+#endif
@@ -0,0 +1,312 @@
+/*
+    The THOR encoder below follows that of the fl-digi program:
+
+    fldigi/src/thor/thor.cxx
+       Copyright (C) 2008-2009
+                  David Freese (w1hkj@w1hkj.com)
+
+       based on code in dominoex.cxx and gmfsk
+
+    fldigi/src/mfsk/interleave.cxx & fldigi/src/filters/viterbi.cxx
+       Copyright (C) 2001, 2002, 2003
+                  Tomi Manninen (oh2bns@sral.fi)
+
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "radio.h"
+#include "hardware.h"
+#include "thor.h"
+#include "symbol.h"
+
+/* Without fldigi's varicode there's nothing a receiver could decode */
+#ifdef THOR_VARICODE
+
+static void thor_init();
+static uint8_t thor_encode(struct radio_symbol *s);
+static PGM_P thor_getname(uint8_t t, uint8_t options);
+static uint32_t thor_airtime(uint8_t options, uint16_t len);
+static uint8_t thor_bit();
+static uint8_t thor_fec(uint8_t bit);
+static uint8_t thor_interleave(uint8_t sym);
+static uint8_t thor_parity(uint8_t x);
+
+const struct radio_mode thor = { thor_init, radio_symbol_isr,
+                                 thor_getname, thor_airtime,
+                                 radio_symbol_refill };
+
+/*
+ * THOR is DominoEX's incremental frequency keying (each symbol is a tone
+ * 2 + value steps up from the last, mod NUM_TONES) carrying 4 bits per
+ * symbol of varicode that has been through a rate 1/2, K = 7
+ * convolutional code and then a diagonal interleaver, so that a tone that
+ * is lost costs a few scattered bits, which the receiver's Viterbi
+ * decoder can usually put back, rather than a character.
+ *
+ * Each character is sent as its code in varicode, below. The transmission
+ * starts with THOR_PREAMBLE bare symbols, for the receiver to find the
+ * tones, and THOR_LEAD zero bits, for its decoder to settle; and ends
+ * with a 1 (the receiver only prints a character once the next one
+ * starts) and then THOR_FLUSH zero bits, to push that out of the encoder
+ * and the interleaver.
+ *
+ * Each speed is a symbol period (TCC0 ticks at DIV64) and a tone spacing
+ * (DAC steps; TONE_SHIFT is 21.5Hz), from fldigi's. The slower three are
+ * double spaced.
+ */
+#define THOR_DIV        RADIO_HW_TIMER_DIV64
+#define THOR_TICKS_MS   125
+
+#define NUM_TONES       18
+#define BASE_VALUE      2103
+#define TONE_SHIFT      36
+
+#define THOR_POLY1      0x6d
+#define THOR_POLY2      0x4f
+#define THOR_DEPTH      4
+
+#define THOR_PREAMBLE   16
+#define THOR_LEAD       8
+#define THOR_FLUSH      32
+
+/* Telemetry averages a little under 10 bits per character */
+#define THOR_BYTE_SYMBOLS 5
+
+#define THOR_STATE_PREAMBLE 0
+#define THOR_STATE_DATA     1
+#define THOR_STATE_FLUSH    2
+
+struct thor_speed
+{
+    uint16_t per;
+    uint8_t shift;
+};
+
+static struct thor_speed thor_speeds[] PROGMEM =
+    { { 5805, 36 }, { 8000, 26 }, { 11610, 18 },
+      { 16000, 26 }, { 23220, 18 }, { 32000, 13 } };
+
+static uint16_t thor_per;
+static uint8_t thor_shift;
+
+/* current_tone carries on from one item to the next, as in domex.c */
+static uint8_t current_tone;
+static uint8_t thor_state, thor_count;
+
+/* The rest of the character being sent, MSB first */
+static uint16_t thor_code;
+static uint8_t thor_code_len;
+
+static uint8_t thor_shreg;
+/* Bit j of thor_inlv[k][i] is fldigi's table[k][i][j] */
+static uint8_t thor_inlv[THOR_DEPTH][4];
+
+/*
+ * The bits each character is sent as, which start with a 1, so their
+ * length is that of the number: fldigi's thorvaricode, generated into
+ * thor_varicode.h (and checked) by /misc-c/pc/tables/thor.c from
+ * fldigi/src/thor/thorvaricode.cxx. The Makefiles define THOR_VARICODE
+ * once it's there.
+ */
+#include "thor_varicode.h"
+
+static void thor_init()
+{
+    uint8_t k, i;
+
+    thor_per = pgm_read_word(&(thor_speeds[radio_current_options].per));
+    thor_shift = pgm_read_byte(&(thor_speeds[radio_current_options].shift));
+
+    thor_state = THOR_STATE_PREAMBLE;
+    thor_count = THOR_PREAMBLE;
+    thor_shreg = 0;
+
+    for (k = 0; k < THOR_DEPTH; k++)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            thor_inlv[k][i] = 0;
+        }
+    }
+
+    radio_symbol_start(THOR_DIV, thor_encode);
+}
+
+static uint8_t thor_encode(struct radio_symbol *s)
+{
+    uint8_t sym;
+
+    if (thor_state == THOR_STATE_PREAMBLE)
+    {
+        sym = 0;
+        thor_count--;
+
+        if (thor_count == 0)
+        {
+            thor_state = THOR_STATE_DATA;
+            thor_code = 0;
+            thor_code_len = THOR_LEAD;
+        }
+    }
+    else
+    {
+        if (thor_state == THOR_STATE_FLUSH && thor_count == 0)
+        {
+            return DATA_SOURCE_FINISHED;
+        }
+
+        /* Two bits in, four out */
+        sym = (thor_fec(thor_bit()) << 2);
+        sym |= thor_fec(thor_bit());
+        sym = thor_interleave(sym);
+    }
+
+    current_tone = (current_tone + 2 + sym);
+
+    if (current_tone >= NUM_TONES)
+    {
+        current_tone -= NUM_TONES;
+    }
+
+    s->value = BASE_VALUE + (current_tone * thor_shift);
+    s->per = thor_per;
+
+    return DATA_SOURCE_OK;
+}
+
+/* The next bit to go through the encoder; zeros once flushing */
+static uint8_t thor_bit()
+{
+    uint16_t code;
+
+    if (thor_state == THOR_STATE_DATA && thor_code_len == 0)
+    {
+        if (radio_data_update() == DATA_SOURCE_OK)
+        {
+            code = pgm_read_word(&(varicode[radio_data_current_byte]));
+            thor_code = code;
+            thor_code_len = 0;
+
+            while (code != 0)
+            {
+                code >>= 1;
+                thor_code_len++;
+            }
+        }
+        else
+        {
+            thor_state = THOR_STATE_FLUSH;
+            thor_count = THOR_FLUSH;
+            return 1;
+        }
+    }
+
+    if (thor_state == THOR_STATE_FLUSH)
+    {
+        if (thor_count != 0)
+        {
+            thor_count--;
+        }
+
+        return 0;
+    }
+
+    thor_code_len--;
+    return (thor_code >> thor_code_len) & 1;
+}
+
+/* Returns the two output bits, POLY1's first (i.e., in bit 1) */
+static uint8_t thor_fec(uint8_t bit)
+{
+    thor_shreg = (thor_shreg << 1) | bit;
+
+    return (thor_parity(thor_shreg & THOR_POLY1) << 1) |
+           thor_parity(thor_shreg & THOR_POLY2);
+}
+
+/*
+ * fldigi's interleave::bits, forwards, with size 4. The MSB of sym is the
+ * first bit.
+ */
+static uint8_t thor_interleave(uint8_t sym)
+{
+    uint8_t k, i, out;
+
+    for (k = 0; k < THOR_DEPTH; k++)
+    {
+        out = 0;
+
+        for (i = 0; i < 4; i++)
+        {
+            thor_inlv[k][i] >>= 1;
+
+            if (sym & (0x08 >> i))
+            {
+                thor_inlv[k][i] |= 0x08;
+            }
+
+            if (thor_inlv[k][i] & (0x08 >> i))
+            {
+                out |= (0x08 >> i);
+            }
+        }
+
+        sym = out;
+    }
+
+    return sym;
+}
+
+static uint8_t thor_parity(uint8_t x)
+{
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return x & 1;
+}
+
+static uint32_t thor_airtime(uint8_t options, uint16_t len)
+{
+    uint32_t symbols;
+
+    symbols = THOR_PREAMBLE + (THOR_LEAD + THOR_FLUSH) / 2 +
+              (uint32_t) len * THOR_BYTE_SYMBOLS;
+
+    return symbols * pgm_read_word(&(thor_speeds[options].per)) /
+           THOR_TICKS_MS;
+}
+
+static char thor_short_names[][7] PROGMEM =
+    { "THOR22", "THOR16", "THOR11", "THOR8", "THOR5", "THOR4" };
+static char thor_long_names[][8] PROGMEM =
+    { "THOR 22", "THOR 16", "THOR 11", "THOR 8", "THOR 5", "THOR 4" };
+
+static PGM_P thor_getname(uint8_t t, uint8_t options)
+{
+    if (t == RADIO_NAME_SHORT)
+    {
+        return thor_short_names[options];
+    }
+    else
+    {
+        return thor_long_names[options];
+    }
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RADIO_THOR_H__
+#define __RADIO_THOR_H__
+
+#include "radio.h"
+
+/* Speeds (options) */
+#define THOR_22 0
+#define THOR_16 1
+#define THOR_11 2
+#define THOR_8  3
+#define THOR_5  4
+#define THOR_4  5
+
+/* Only once radio/thor_varicode.h has been generated; see thor.c */
+#ifdef THOR_VARICODE
+extern const struct radio_mode thor;
+#endif
+
+#endif
@@ -16,21 +16,35 @@
 */
 
 #include <stdint.h>
+#include <string.h>
 #include <avr/pgmspace.h>
 
 #include "radio.h"
 #include "hardware.h"
+#include "rtty.h"
+#include "sched.h"
 #include "uplink.h"
 
-/* DEBUG: XXX */
-#include "../debug/debug.h"
+#include "../debug/trace.h"
 
 static void uplink_init();
 static uint8_t uplink_interrupt();
 static PGM_P uplink_getname(uint8_t t, uint8_t options);
+static uint32_t uplink_airtime(uint8_t options, uint16_t len);
+static uint8_t uplink_discriminate(uint16_t af);
+static uint32_t uplink_energy(int32_t i, int32_t q);
+static void uplink_receive(uint8_t level);
+static void uplink_frame_byte(uint8_t c);
+static uint8_t uplink_hex(uint8_t n);
+static void uplink_measure(uint8_t level, uint16_t rssi);
+static void uplink_link_update();
+static uint8_t uplink_link_level(uint16_t rssi, uint8_t clear,
+                                 uint8_t rising);
+static uint8_t uplink_next(struct data_source *source,
+                           struct data_span *span);
 
 const struct radio_mode uplink = { uplink_init, uplink_interrupt,
-                                   uplink_getname };
+                                   uplink_getname, uplink_airtime, NULL };
 
 /*
 #define UPLINK_NOISECHK   0
@@ -42,42 +56,579 @@ const struct radio_mode uplink = { uplink_init, uplink_interrupt,
 static uint8_t uplink_status;
 */
 
-/* TESTING XXX */
-static uint16_t uplink_samples;
+/*
+ * Uplink is 50baud. We'll make 32 samples per bit, i.e., 1600Hz. Samples
+ * are captured by DMA, RADIO_HW_CAPTURE_LEN at a time.
+ */
+#define UPLINK_BAUD       50
+#define UPLINK_OVERSAMPLE 32
+#define UPLINK_PERIOD     (F_CPU / (UPLINK_BAUD * UPLINK_OVERSAMPLE))
+
+/*
+ * Tone discrimination: for each of the two tones we keep a single DFT bin
+ * over the last UPLINK_WINDOW (one bit) samples, updated every sample.
+ * Since the window holds a whole number of cycles of each tone, the sample
+ * leaving the window was multiplied by the same table entry as the one
+ * arriving, so we only need to add (new - old) * table; in integers this
+ * is exact and never drifts. It also means any DC offset cancels out.
+ *
+ * Bins are 1600 / 32 = 50Hz apart; mark is 300Hz and space is 500Hz.
+ */
+#define UPLINK_WINDOW     UPLINK_OVERSAMPLE
+#define UPLINK_MARK_BIN   6
+#define UPLINK_SPACE_BIN  10
+
+/* Below this (mark + space energy) we're hearing noise; about 25 LSBs */
+#define UPLINK_SQUELCH    10000
+
+#define LEVEL_SPACE 0
+#define LEVEL_MARK  1
+#define LEVEL_NOISE 2
+
+/* sin(2 * pi * n / 32) * 127; cos is a quarter (8 entries) later */
+static int8_t uplink_sine[UPLINK_WINDOW] PROGMEM =
+    { 0, 25, 49, 71, 90, 106, 117, 125, 127, 125, 117, 106, 90, 71, 49, 25,
+      0, -25, -49, -71, -90, -106, -117, -125,
+      -127, -125, -117, -106, -90, -71, -49, -25 };
+
+static uint16_t window[UPLINK_WINDOW];
+static uint8_t window_pos;
+static int32_t mark_i, mark_q, space_i, space_q;
+
+/* The stronger tone has more than 2^UPLINK_CLEAR_SHIFT times the energy */
+#define UPLINK_CLEAR_SHIFT 3
+static uint8_t uplink_clear;
+
+/*
+ * Async 8N1 framing. Timing is recovered from the leading edge of each
+ * start bit: the window notices the edge half a window late, and another
+ * half window later it covers exactly the start bit. Every
+ * UPLINK_OVERSAMPLE samples after that it covers exactly the next bit.
+ */
+#define RX_HUNT  0
+#define RX_START 1
+#define RX_DATA  2
+#define RX_STOP  3
+static uint8_t rx_state, rx_count, rx_bits, rx_byte, rx_last;
+
+/*
+ * Frames look like our telemetry: $<payload>*<xor checksum, hex>\n
+ * A $ always (re)starts a frame. The payload is put together in frame;
+ * once the frame checks out it is latched into uplink_frame, which stays
+ * until the next one (in this slot or a later one) replaces it.
+ */
+#define FRAME_IDLE    0
+#define FRAME_DATA    1
+#define FRAME_CHECK_A 2
+#define FRAME_CHECK_B 3
+#define FRAME_END     4
+static uint8_t frame_state, frame_pos, frame_checksum, frame_done;
+static uint8_t frame[UPLINK_MAX_LEN];
+
+uint8_t uplink_frame[UPLINK_MAX_LEN];
+uint8_t uplink_frame_len;
+static uint8_t uplink_source_sent;
+
+struct data_source uplink_source = { uplink_next };
+
+/*
+ * Each frame is confirmed by queueing uplink_reply, which sends
+ *
+ *   $$A2,UP,<payload>*<xor checksum hex>\n
+ *
+ * in RTTY_SLOW. If another frame comes in before it has gone, the reply
+ * (still queued) confirms the newer one.
+ */
+static char uplink_reply_head[] PROGMEM = "$$A2,UP,";
+static struct data_flash uplink_reply_head_source =
+    DATA_FLASH((const uint8_t *) uplink_reply_head,
+               sizeof(uplink_reply_head) - 1);
+static struct data_source *const uplink_reply_parts[] =
+    { &uplink_reply_head_source.source, &uplink_source };
+static struct data_concat uplink_reply_body =
+    DATA_CONCAT(uplink_reply_parts, 2);
+static struct data_checksum uplink_reply_source =
+    DATA_CHECKSUM(&uplink_reply_body.source, DATA_CHECKSUM_XOR, 2);
+
+/* <$$A2,UP,> <payload> <*HH\n> */
+#define UPLINK_REPLY_LEN(n)  (sizeof(uplink_reply_head) - 1 + (n) + 4)
+
+static struct radio_queue_item uplink_reply =
+    { { &rtty, &uplink_reply_source.source, RTTY_SLOW }, 0, NULL };
+static uint8_t uplink_reply_queued;
+
+/* Give up if nothing has been decoded after 32 seconds */
+#define UPLINK_TIMEOUT_S  32
+#define UPLINK_TIMEOUT_BLOCKS \
+    ((UPLINK_TIMEOUT_S * 1UL * UPLINK_BAUD * UPLINK_OVERSAMPLE) / \
+     RADIO_HW_CAPTURE_LEN)
+static uint16_t uplink_blocks;
+static uint8_t uplink_capturing;
+
+/*
+ * Link quality. While the squelch is open, the RSSI is added up, and the
+ * samples where the stronger tone has at least 8 times (9dB) the energy of
+ * the other are counted as clear: noise in the AF shows up as the
+ * fraction that aren't. At the end of the slot, the mean RSSI and the
+ * clear fraction (of 256) rate the link as the best level whose
+ * thresholds both meet.
+ *
+ * The link drops to a lower rating at once, so that a receiver falling
+ * out of range isn't left with a mode it can't decode; but only rises one
+ * level at a time, after UPLINK_RISE_SLOTS slots in a row that met the
+ * next level's thresholds with UPLINK_RISE_RSSI and UPLINK_RISE_CLEAR to
+ * spare. A slot in which the ground station wasn't heard (for
+ * UPLINK_MIN_HEARD samples) counts as no better than FAIR.
+ *
+ * The clear thresholds are from the simulator: a clean signal is about
+ * 82% clear (the window straddles a bit edge for part of every bit), and
+ * frames stop decoding at about 50%.
+ *
+ * The RSSI thresholds (ADC counts, 12 bit against VCC) are NOT calibrated,
+ * and must be tuned on the flight receiver. Until then FAIR and GOOD are
+ * twice and four times the simulator's receiver floor (UPLINK_RSSI_FLOOR
+ * in sim/uplink.c, 300). To tune them, read the mean RSSI in the link
+ * trace records (misc-c/pc/tracedump) with the ground station off, and
+ * then sending from as far out as RTTY50 (for FAIR) and RTTY300 (for
+ * GOOD) still decode on the ground; put each threshold there.
+ */
+#define UPLINK_MIN_HEARD   (UPLINK_BAUD * UPLINK_OVERSAMPLE)
+#define UPLINK_RISE_SLOTS  2
+#define UPLINK_RISE_RSSI   64
+#define UPLINK_RISE_CLEAR  12
+
+#define UPLINK_RSSI_FAIR   600   /* To tune: see above */
+#define UPLINK_RSSI_GOOD   1200  /* To tune */
+
+static uint16_t uplink_rssi_min[UPLINK_LINKS] PROGMEM =
+    { 0, UPLINK_RSSI_FAIR, UPLINK_RSSI_GOOD };
+static uint8_t uplink_clear_min[UPLINK_LINKS] PROGMEM = { 0, 140, 180 };
+
+uint8_t uplink_link = UPLINK_LINK_FAIR;
+static uint8_t uplink_rises;
+static uint32_t uplink_rssi_sum;
+static uint16_t uplink_heard, uplink_clear_count;
+
+/* <heard samples: 2> <mean RSSI: 2> <clear, of 256: 1> <link: 1> */
+#define UPLINK_LINK_RECORD_LEN 6
 
 static void uplink_init()
 {
-    /* 
-     * Uplink is 50baud. We'll make 32 samples (but only 16 will count).
-     * i.e., 1600baud:
-     */
     radio_hw_mode(RADIO_HW_MODE_RX);
-    radio_hw_timer_set(RADIO_HW_TIMER_DIV1, 5000);
+    radio_hw_capture_start(RADIO_HW_TIMER_DIV1, UPLINK_PERIOD);
+
+    /* window is filled from the first sample; see uplink_interrupt */
+    window_pos = 0;
+    mark_i = mark_q = space_i = space_q = 0;
+
+    rx_state = RX_HUNT;
+    rx_last = LEVEL_NOISE;
+    frame_state = FRAME_IDLE;
+    frame_done = 0;
 
-    uplink_samples = 0;
+    uplink_blocks = 0;
+    uplink_capturing = 0;
+
+    uplink_rssi_sum = 0;
+    uplink_heard = 0;
+    uplink_clear_count = 0;
 }
 
 static uint8_t uplink_interrupt()
 {
-    struct
+    struct radio_hw_sample *block;
+    uint8_t i, level;
+
+    /* radio_isr calls us once straight after uplink_init; no block yet */
+    if (!uplink_capturing)
+    {
+        uplink_capturing = 1;
+        return RADIO_INTERRUPT_OK;
+    }
+
+    block = radio_hw_capture_block();
+
+    /*
+     * Start the window full of the first sample, not zeros, which would
+     * look like a step (and so a tone) until it had all gone. Both bins
+     * of a constant window are zero, so the sums are right as they are.
+     */
+    if (uplink_blocks == 0)
+    {
+        for (i = 0; i < UPLINK_WINDOW; i++)
+        {
+            window[i] = block[0].af;
+        }
+    }
+
+    for (i = 0; i < RADIO_HW_CAPTURE_LEN; i++)
     {
-        uint8_t hdr;
-        uint16_t af;
-        uint16_t rssi;
-        uint8_t tail;
-    } message;
+        level = uplink_discriminate(block[i].af);
+        uplink_measure(level, block[i].rssi);
+        uplink_receive(level);
 
-    message.hdr = 0xFC;
-    message.tail = 0xF2;
-    radio_hw_adc_get(&message.af, &message.rssi);
-    debug_write((uint8_t *) &message, sizeof(message));
+        if (frame_done)
+        {
+            trace_write(TRACE_UPLINK, uplink_frame, uplink_frame_len);
 
-    uplink_samples++;
+            /* We're in the radio ISR, like the scheduler */
+            uplink_reply.len = UPLINK_REPLY_LEN(uplink_frame_len);
 
-    if (uplink_samples == 51200)
+            if (!uplink_reply_queued)
+            {
+                uplink_reply_queued = 1;
+                radio_queue_add(&uplink_reply);
+            }
+
+            radio_hw_capture_stop();
+            uplink_link_update();
+            return RADIO_INTERRUPT_FINISHED;
+        }
+    }
+
+    uplink_blocks++;
+
+    if (uplink_blocks == UPLINK_TIMEOUT_BLOCKS)
+    {
+        radio_hw_capture_stop();
+        uplink_link_update();
         return RADIO_INTERRUPT_FINISHED;
+    }
     else
+    {
         return RADIO_INTERRUPT_OK;
+    }
+}
+
+static uint8_t uplink_discriminate(uint16_t af)
+{
+    int16_t delta;
+    uint8_t mark_phase, space_phase;
+    int8_t s, c;
+    uint32_t mark, space;
+
+    delta = af - window[window_pos];
+    window[window_pos] = af;
+
+    mark_phase = (UPLINK_MARK_BIN * window_pos) & (UPLINK_WINDOW - 1);
+    space_phase = (UPLINK_SPACE_BIN * window_pos) & (UPLINK_WINDOW - 1);
+    window_pos = (window_pos + 1) & (UPLINK_WINDOW - 1);
+
+    s = pgm_read_byte(&(uplink_sine[mark_phase]));
+    c = pgm_read_byte(&(uplink_sine[(mark_phase + UPLINK_WINDOW / 4) &
+                                    (UPLINK_WINDOW - 1)]));
+    mark_i += (int32_t) delta * c;
+    mark_q += (int32_t) delta * s;
+
+    s = pgm_read_byte(&(uplink_sine[space_phase]));
+    c = pgm_read_byte(&(uplink_sine[(space_phase + UPLINK_WINDOW / 4) &
+                                    (UPLINK_WINDOW - 1)]));
+    space_i += (int32_t) delta * c;
+    space_q += (int32_t) delta * s;
+
+    mark = uplink_energy(mark_i, mark_q);
+    space = uplink_energy(space_i, space_q);
+
+    if (mark + space < UPLINK_SQUELCH)
+    {
+        return LEVEL_NOISE;
+    }
+    else if (mark > space)
+    {
+        uplink_clear = ((mark >> UPLINK_CLEAR_SHIFT) > space);
+        return LEVEL_MARK;
+    }
+    else
+    {
+        uplink_clear = ((space >> UPLINK_CLEAR_SHIFT) > mark);
+        return LEVEL_SPACE;
+    }
+}
+
+/*
+ * |i|, |q| <= 4095 * 127 * 32 < 2^24, so after dropping 9 bits the sum of
+ * the squares fits in 31 bits
+ */
+static uint32_t uplink_energy(int32_t i, int32_t q)
+{
+    int16_t a, b;
+
+    a = i >> 9;
+    b = q >> 9;
+
+    return ((int32_t) a * a) + ((int32_t) b * b);
+}
+
+static void uplink_receive(uint8_t level)
+{
+    if (rx_state == RX_HUNT)
+    {
+        if (rx_last == LEVEL_MARK && level == LEVEL_SPACE)
+        {
+            rx_state = RX_START;
+            rx_count = UPLINK_WINDOW / 2;
+        }
+    }
+    else
+    {
+        rx_count--;
+
+        if (rx_count == 0)
+        {
+            rx_count = UPLINK_OVERSAMPLE;
+
+            if (level == LEVEL_NOISE)
+            {
+                rx_state = RX_HUNT;
+            }
+            else if (rx_state == RX_START)
+            {
+                if (level == LEVEL_SPACE)
+                {
+                    rx_state = RX_DATA;
+                    rx_bits = 0;
+                }
+                else
+                {
+                    /* glitch */
+                    rx_state = RX_HUNT;
+                }
+            }
+            else if (rx_state == RX_DATA)
+            {
+                /* LSB first */
+                rx_byte >>= 1;
+
+                if (level == LEVEL_MARK)
+                {
+                    rx_byte |= 0x80;
+                }
+
+                rx_bits++;
+
+                if (rx_bits == 8)
+                {
+                    rx_state = RX_STOP;
+                }
+            }
+            else
+            {
+                if (level == LEVEL_MARK)
+                {
+                    uplink_frame_byte(rx_byte);
+                }
+
+                /* else: framing error */
+                rx_state = RX_HUNT;
+            }
+        }
+    }
+
+    rx_last = level;
+}
+
+static void uplink_frame_byte(uint8_t c)
+{
+    if (c == '$')
+    {
+        frame_state = FRAME_DATA;
+        frame_pos = 0;
+        frame_checksum = 0;
+        return;
+    }
+
+    switch (frame_state)
+    {
+        case FRAME_DATA:
+            if (c == '*')
+            {
+                frame_state = FRAME_CHECK_A;
+            }
+            else if (frame_pos == UPLINK_MAX_LEN)
+            {
+                frame_state = FRAME_IDLE;
+            }
+            else
+            {
+                frame[frame_pos] = c;
+                frame_pos++;
+                frame_checksum ^= c;
+            }
+            break;
+
+        case FRAME_CHECK_A:
+            if (c == uplink_hex(frame_checksum >> 4))
+            {
+                frame_state = FRAME_CHECK_B;
+            }
+            else
+            {
+                frame_state = FRAME_IDLE;
+            }
+            break;
+
+        case FRAME_CHECK_B:
+            if (c == uplink_hex(frame_checksum & 0x0F))
+            {
+                frame_state = FRAME_END;
+            }
+            else
+            {
+                frame_state = FRAME_IDLE;
+            }
+            break;
+
+        case FRAME_END:
+            if (c == '\n' && frame_pos != 0)
+            {
+                memcpy(uplink_frame, frame, frame_pos);
+                uplink_frame_len = frame_pos;
+                frame_done = 1;
+            }
+
+            frame_state = FRAME_IDLE;
+            break;
+    }
+}
+
+/* Samples past 65535 (41 seconds) would wrap, but the slot is shorter */
+static void uplink_measure(uint8_t level, uint16_t rssi)
+{
+    if (level == LEVEL_NOISE)
+    {
+        return;
+    }
+
+    uplink_heard++;
+    uplink_rssi_sum += rssi;
+
+    if (uplink_clear)
+    {
+        uplink_clear_count++;
+    }
+}
+
+static void uplink_link_update()
+{
+    uint16_t rssi;
+    uint8_t clear, best, rise;
+#if DEBUG
+    uint8_t *p;
+#endif
+
+    if (uplink_heard >= UPLINK_MIN_HEARD)
+    {
+        rssi = uplink_rssi_sum / uplink_heard;
+        clear = ((uint32_t) uplink_clear_count << 8) / (uplink_heard + 1);
+        best = uplink_link_level(rssi, clear, 0);
+        rise = uplink_link_level(rssi, clear, 1);
+    }
+    else
+    {
+        rssi = 0;
+        clear = 0;
+        best = UPLINK_LINK_FAIR;
+        rise = UPLINK_LINK_POOR;
+    }
+
+    if (best < uplink_link)
+    {
+        uplink_link = best;
+        uplink_rises = 0;
+    }
+    else if (rise > uplink_link)
+    {
+        uplink_rises++;
+
+        if (uplink_rises == UPLINK_RISE_SLOTS)
+        {
+            uplink_link++;
+            uplink_rises = 0;
+        }
+    }
+    else
+    {
+        uplink_rises = 0;
+    }
+
+#if DEBUG
+    p = trace_reserve(TRACE_LINK, UPLINK_LINK_RECORD_LEN);
+
+    if (p != NULL)
+    {
+        p = trace_put_uint(p, uplink_heard, 2);
+        p = trace_put_uint(p, rssi, 2);
+        p = trace_put_uint(p, clear, 1);
+        p = trace_put_uint(p, uplink_link, 1);
+        trace_commit(p - UPLINK_LINK_RECORD_LEN);
+    }
+#endif
+}
+
+/* The best level whose thresholds are met (with room to spare, if rising) */
+static uint8_t uplink_link_level(uint16_t rssi, uint8_t clear,
+                                 uint8_t rising)
+{
+    uint16_t rssi_min, clear_min;
+    uint8_t level;
+
+    for (level = UPLINK_LINKS - 1; level != 0; level--)
+    {
+        rssi_min = pgm_read_word(&(uplink_rssi_min[level]));
+        clear_min = pgm_read_byte(&(uplink_clear_min[level]));
+
+        if (rising)
+        {
+            rssi_min += UPLINK_RISE_RSSI;
+            clear_min += UPLINK_RISE_CLEAR;
+        }
+
+        if (rssi >= rssi_min && clear >= clear_min)
+        {
+            break;
+        }
+    }
+
+    return level;
+}
+
+static uint8_t uplink_hex(uint8_t n)
+{
+    if (n < 10)
+    {
+        return '0' + n;
+    }
+    else
+    {
+        return 'A' - 10 + n;
+    }
+}
+
+/*
+ * The payload of the last frame that was decoded. Once it has gone out
+ * the reply is done, so the next frame queues it again.
+ */
+static uint8_t uplink_next(struct data_source *source,
+                           struct data_span *span)
+{
+    if (uplink_source_sent || uplink_frame_len == 0)
+    {
+        uplink_source_sent = 0;
+        uplink_reply_queued = 0;
+        return DATA_SOURCE_FINISHED;
+    }
+
+    span->data = uplink_frame;
+    span->len = uplink_frame_len;
+    span->flags = DATA_SPAN_RAM;
+    uplink_source_sent = 1;
+    return DATA_SOURCE_OK;
+}
+
+/* Plan for the timeout; a frame usually ends it sooner */
+static uint32_t uplink_airtime(uint8_t options, uint16_t len)
+{
+    return UPLINK_TIMEOUT_S * 1000UL;
 }
 
 static char uplink_short_name[] PROGMEM = "UPL";
@@ -20,6 +20,29 @@
 
 #include "radio.h"
 
+#define UPLINK_MAX_LEN 32
+
 extern const struct radio_mode uplink;
 
+/*
+ * The payload of the last frame decoded, kept until the next one, and its
+ * length (0 until there is one). uplink_source serves it; each frame is
+ * confirmed over the downlink by a queued reply (see uplink.c).
+ */
+extern uint8_t uplink_frame[UPLINK_MAX_LEN];
+extern uint8_t uplink_frame_len;
+
+extern struct data_source uplink_source;
+
+/*
+ * How good the link is, as measured by the uplink slots so far (see
+ * uplink.c): the scheduler sends in faster modes the better it is.
+ */
+#define UPLINK_LINK_POOR 0
+#define UPLINK_LINK_FAIR 1
+#define UPLINK_LINK_GOOD 2
+#define UPLINK_LINKS     3
+
+extern uint8_t uplink_link;
+
 #endif
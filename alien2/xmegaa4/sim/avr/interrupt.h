@@ -15,20 +15,14 @@
     see <http://www.gnu.org/licenses/>.
 */
 
-#ifndef __DEBUG_BUFFER_H__
-#define __DEBUG_BUFFER_H__
+/* Host stand-in for <avr/interrupt.h>: there is only one context. */
 
-#include <stdint.h>
-#include "debug.h"
+#ifndef __SIM_AVR_INTERRUPT_H__
+#define __SIM_AVR_INTERRUPT_H__
 
-#if DEBUG
+#define sei()
+#define cli()
 
-#define BUFFER_OK       0
-#define BUFFER_OVERFLOW 1
-
-uint8_t buffer_write(uint8_t *data, uint16_t len);
-uint8_t buffer_read_byte(uint8_t *b);
-
-#endif
+#define ISR(vector) void vector(void)
 
 #endif
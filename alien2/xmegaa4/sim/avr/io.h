@@ -0,0 +1,41 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Host stand-in for <avr/io.h>. Only the constants that the radio code
+ * passes to hardware.c are provided; anything that touches a register
+ * belongs in radio/hardware.c, which the simulator replaces.
+ */
+
+#ifndef __SIM_AVR_IO_H__
+#define __SIM_AVR_IO_H__
+
+#include <stdint.h>
+
+/* Saved and restored around cli(); see sim/hardware.c */
+extern uint8_t SREG;
+
+#define TC_CLKSEL_OFF_gc     0
+#define TC_CLKSEL_DIV1_gc    1
+#define TC_CLKSEL_DIV2_gc    2
+#define TC_CLKSEL_DIV4_gc    3
+#define TC_CLKSEL_DIV8_gc    4
+#define TC_CLKSEL_DIV64_gc   5
+#define TC_CLKSEL_DIV256_gc  6
+#define TC_CLKSEL_DIV1024_gc 7
+
+#endif
@@ -0,0 +1,43 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Host stand-in for avr-libc's <avr/pgmspace.h>. On the PC "flash" is just
+ * ordinary read-only memory, so the pgm_read_* functions are plain loads.
+ */
+
+#ifndef __SIM_AVR_PGMSPACE_H__
+#define __SIM_AVR_PGMSPACE_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+
+#define PGM_P const char *
+typedef unsigned char prog_uchar;
+
+#define pgm_read_byte(addr) (*((const uint8_t *) (addr)))
+#define strlen_P(s) strlen(s)
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
+
+/* The AVR is little endian; don't rely on the host being so */
+#define pgm_read_word(addr)                                                 \
+    ((uint16_t) (pgm_read_byte(addr) |                                      \
+                 (pgm_read_byte(((const uint8_t *) (addr)) + 1) << 8)))
+
+#endif
@@ -0,0 +1,326 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../radio/hardware.h"
+#include "../radio/radio.h"
+#include "../telem/monitor.h"
+#include "sim.h"
+
+/*
+ * Replaces radio/hardware.c. Rather than poking DACB, ADCA and TCC0 it
+ * records each call as a timestamped sim_event and models TCC0 well enough
+ * for main.c to know when the next overflow (and so radio_isr) is due.
+ *
+ * DMA playout is modelled at the level radio/hardware.c relies on: on each
+ * timer event the DAC outputs whatever is pending in CH0DATA, and the
+ * active channel immediately refills it. A completed transaction raises an
+ * "interrupt" that is delivered (by calling radio_isr) once the current
+ * one has returned, as it would be on the real thing. DMA capture is
+ * modelled the same way: each timer event adds one sample to a block.
+ */
+
+uint64_t sim_time;
+uint8_t SREG;
+
+static uint8_t timer_div;
+static uint16_t timer_per, timer_perbuf;
+static uint8_t timer_perbuf_valid;
+static uint64_t timer_next;
+
+static uint16_t dma_buf[2][RADIO_HW_DMA_BUFFER_LEN];
+static uint8_t dma_len[2], dma_pos[2], dma_armed[2];
+static uint8_t dma_running, dma_active, dma_next, dma_drain_status;
+static uint8_t dma_irq_pending;
+static uint16_t dma_last_value;
+static uint16_t dac_pending;
+static uint8_t dac_pending_valid;
+
+static struct radio_hw_sample capture_buf[2][RADIO_HW_CAPTURE_LEN];
+static uint8_t capture_running, capture_active, capture_next, capture_pos;
+
+static void sim_dma_transfer();
+
+/* Prescaler for each TC_CLKSEL value; 0 means stopped */
+static const uint16_t timer_prescaler[8] = { 0, 1, 2, 4, 8, 64, 256, 1024 };
+
+static void sim_emit(uint8_t type, uint8_t div, uint16_t value)
+{
+    struct sim_event e;
+
+    e.time = sim_time;
+    e.type = type;
+    e.div = div;
+    e.value = value;
+
+    sim_log_event(&e);
+    sim_render_event(&e);
+}
+
+void radio_hw_init()
+{
+    timer_div = 0;
+    timer_perbuf_valid = 0;
+    dma_running = 0;
+    capture_running = 0;
+    dma_irq_pending = 0;
+}
+
+void radio_hw_dac_set(uint16_t value)
+{
+    sim_emit(SIM_EVENT_DAC, 0, value);
+}
+
+void radio_hw_adc_get(uint16_t *af, uint16_t *rssi)
+{
+    *af = sim_uplink_af();
+    *rssi = sim_uplink_rssi();
+}
+
+void radio_hw_timer_set(uint8_t div, uint16_t per)
+{
+    timer_div = div;
+    timer_per = per;
+    timer_perbuf_valid = 0;
+
+    /* The counter counts 0..PER inclusive, so a period is PER + 1 ticks */
+    timer_next = sim_time + ((uint64_t) per + 1) * timer_prescaler[div & 7];
+
+    sim_emit(SIM_EVENT_TIMER, div, per);
+}
+
+void radio_hw_queue_period_update(uint16_t per)
+{
+    timer_perbuf = per;
+    timer_perbuf_valid = 1;
+
+    sim_emit(SIM_EVENT_PERBUF, timer_div, per);
+}
+
+void radio_hw_mode(uint8_t mode)
+{
+    sim_emit(SIM_EVENT_MODE, 0, mode);
+}
+
+/* The simulation clock is in CPU cycles already */
+uint32_t radio_hw_ticks()
+{
+    return (uint32_t) sim_time;
+}
+
+void radio_hw_dma_start(uint8_t div, uint16_t per)
+{
+    radio_hw_timer_set(div, per);
+
+    dma_running = 1;
+    dma_active = 0;
+    dma_next = 0;
+    dma_drain_status = 0;
+    dma_armed[0] = dma_armed[1] = 0;
+    dac_pending_valid = 0;
+}
+
+uint16_t *radio_hw_dma_buffer()
+{
+    return dma_buf[dma_next];
+}
+
+void radio_hw_dma_queue(uint8_t len)
+{
+    dma_len[dma_next] = len;
+    dma_pos[dma_next] = 0;
+    dma_armed[dma_next] = 1;
+    dma_last_value = dma_buf[dma_next][len - 1];
+    dma_next ^= 1;
+
+    /* CH0DATA may already be empty */
+    sim_dma_transfer();
+}
+
+uint8_t radio_hw_dma_drain()
+{
+    /* See radio/hardware.c; double buffering isn't modelled, so no PAD */
+    if (dma_drain_status == 0)
+    {
+        dma_buf[dma_next][0] = dma_last_value;
+        radio_hw_dma_queue(1);
+        dma_drain_status = 1;
+        return RADIO_HW_DMA_BUSY;
+    }
+    else if (dma_drain_status == 1)
+    {
+        dma_drain_status = 2;
+        return RADIO_HW_DMA_BUSY;
+    }
+    else
+    {
+        dma_running = 0;
+
+        if (dac_pending_valid)
+        {
+            sim_emit(SIM_EVENT_DAC, 0, dac_pending);
+            dac_pending_valid = 0;
+        }
+
+        return RADIO_HW_DMA_DONE;
+    }
+}
+
+/* CH0DATA empty: the active channel, if armed, moves one value into it */
+static void sim_dma_transfer()
+{
+    if (dac_pending_valid || !dma_armed[dma_active])
+    {
+        return;
+    }
+
+    dac_pending = dma_buf[dma_active][dma_pos[dma_active]];
+    dac_pending_valid = 1;
+    dma_pos[dma_active]++;
+
+    if (dma_pos[dma_active] == dma_len[dma_active])
+    {
+        dma_armed[dma_active] = 0;
+        dma_active ^= 1;
+        dma_irq_pending++;
+    }
+}
+
+void radio_hw_capture_start(uint8_t div, uint16_t per)
+{
+    radio_hw_timer_set(div, per);
+
+    capture_running = 1;
+    capture_active = 0;
+    capture_next = 0;
+    capture_pos = 0;
+}
+
+struct radio_hw_sample *radio_hw_capture_block()
+{
+    struct radio_hw_sample *block;
+
+    block = capture_buf[capture_next];
+    capture_next ^= 1;
+    return block;
+}
+
+void radio_hw_capture_stop()
+{
+    capture_running = 0;
+}
+
+/* A sweep has completed; DMA copies it to the active capture buffer */
+static void sim_capture_sample()
+{
+    struct radio_hw_sample *s;
+
+    s = &(capture_buf[capture_active][capture_pos]);
+    radio_hw_adc_get(&(s->af), &(s->rssi));
+    capture_pos++;
+
+    if (capture_pos == RADIO_HW_CAPTURE_LEN)
+    {
+        capture_pos = 0;
+        capture_active ^= 1;
+        dma_irq_pending++;
+    }
+}
+
+uint8_t sim_timer_running()
+{
+    return timer_prescaler[timer_div & 7] != 0;
+}
+
+uint64_t sim_timer_next()
+{
+    return timer_next;
+}
+
+/*
+ * Called by main.c once sim_time has reached sim_timer_next(). Like the
+ * real TCC0, PERBUF is copied into PER on the overflow (UPDATE) event.
+ * Either the overflow interrupt runs radio_isr, or the timer event clocks
+ * the DAC for DMA playout.
+ */
+void sim_timer_fire()
+{
+    if (timer_perbuf_valid)
+    {
+        timer_per = timer_perbuf;
+        timer_perbuf_valid = 0;
+    }
+
+    timer_next = sim_time +
+                 ((uint64_t) timer_per + 1) * timer_prescaler[timer_div & 7];
+
+    if (dma_running)
+    {
+        if (dac_pending_valid)
+        {
+            sim_emit(SIM_EVENT_DAC, 0, dac_pending);
+            dac_pending_valid = 0;
+        }
+
+        sim_dma_transfer();
+    }
+    else if (capture_running)
+    {
+        sim_capture_sample();
+    }
+    else
+    {
+        radio_isr();
+    }
+
+    sim_irq_deliver();
+}
+
+/* Run radio_isr for each DMA transaction that has completed meanwhile */
+void sim_irq_deliver()
+{
+    while (dma_irq_pending)
+    {
+        dma_irq_pending--;
+        radio_isr();
+    }
+}
+
+/*
+ * Stands in for the monitor timer and ADCA_CH3_vect: a second's worth of
+ * samples at once, each with a count or two of noise. The supply reads
+ * SIM_SUPPLY, about 2/3 of full scale.
+ */
+#define SIM_SUPPLY 2730
+
+static uint16_t sim_monitor_noise(uint16_t value)
+{
+    return value + (rand() % 5) - 2;
+}
+
+void sim_monitor_second()
+{
+    uint16_t i;
+
+    for (i = 0; i < RADIO_HW_MONITOR_HZ; i++)
+    {
+        monitor_sample(sim_monitor_noise(sim_uplink_rssi()),
+                       sim_monitor_noise(SIM_SUPPLY));
+    }
+}
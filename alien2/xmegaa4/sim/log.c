@@ -0,0 +1,78 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../radio/hardware.h"
+#include "sim.h"
+
+/*
+ * One line per event, e.g. "   8000000 dac 2700". Times are in CPU cycles
+ * so that the log diffs cleanly between runs.
+ */
+
+static FILE *log_file;
+
+void sim_log_open(FILE *f)
+{
+    log_file = f;
+}
+
+void sim_log_event(const struct sim_event *e)
+{
+    if (log_file == NULL)
+    {
+        return;
+    }
+
+    fprintf(log_file, "%12llu ", (unsigned long long) e->time);
+
+    switch (e->type)
+    {
+        case SIM_EVENT_DAC:
+            fprintf(log_file, "dac %u\n", e->value);
+            break;
+
+        case SIM_EVENT_TIMER:
+            fprintf(log_file, "timer %u %u\n", e->div, e->value);
+            break;
+
+        case SIM_EVENT_PERBUF:
+            fprintf(log_file, "perbuf %u\n", e->value);
+            break;
+
+        case SIM_EVENT_MODE:
+            if (e->value == RADIO_HW_MODE_TX)
+            {
+                fprintf(log_file, "mode tx\n");
+            }
+            else if (e->value == RADIO_HW_MODE_TXOFF)
+            {
+                fprintf(log_file, "mode txoff\n");
+            }
+            else if (e->value == RADIO_HW_MODE_RX)
+            {
+                fprintf(log_file, "mode rx\n");
+            }
+            else
+            {
+                fprintf(log_file, "mode idle\n");
+            }
+            break;
+    }
+}
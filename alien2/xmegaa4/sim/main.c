@@ -0,0 +1,164 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * radiosim: runs the alien2 radio code (radio.c, sched.c and the modes) on
+ * the PC against sim/hardware.c, as fast as the PC can go.
+ *
+ *   ./radiosim [-s seconds] [-o out.wav] [-e events.txt] [-d debug.txt]
+ *              [-u payload] [-n noise] [-r rssi]
+ *
+ * -s is simulated airtime (default 60). -o renders the baseband to a 48kHz
+ * WAV; -e writes the event log ("-" for stdout) for regression diffs.
+ * -d is where the debug trace goes ("-" for stdout); it's binary, so read
+ * it with misc-c/pc/tracedump. -u makes a ground station send payload as
+ * an uplink frame, with -n LSBs rms of noise on the AF and the RSSI
+ * reading -r while it does (see radio/uplink.c's link quality).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../debug/debug.h"
+#include "../radio/radio.h"
+#include "../telem/monitor.h"
+#include "../telem/telem.h"
+#include "../ssdv/ssdv.h"
+#include "../test.h"
+#include "sim.h"
+
+int main(int argc, char **argv)
+{
+    uint64_t end, tick;
+    double seconds, noise;
+    uint16_t rssi;
+    char *payload;
+    FILE *f;
+    int opt;
+
+    seconds = 60;
+    noise = 0;
+    rssi = 2000;
+    payload = NULL;
+
+    while ((opt = getopt(argc, argv, "s:o:e:d:u:n:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                seconds = atof(optarg);
+                break;
+
+            case 'o':
+                f = fopen(optarg, "wb");
+                if (f == NULL || sim_render_open(f) != 0)
+                {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+
+            case 'e':
+            case 'd':
+                if (strcmp(optarg, "-") == 0)
+                {
+                    f = stdout;
+                }
+                else
+                {
+                    f = fopen(optarg, "w");
+                }
+
+                if (f == NULL)
+                {
+                    perror(optarg);
+                    return 1;
+                }
+
+                if (opt == 'e')
+                {
+                    sim_log_open(f);
+                }
+                else
+                {
+                    sim_debug_open(f);
+                }
+                break;
+
+            case 'u':
+                payload = optarg;
+                break;
+
+            case 'n':
+                noise = atof(optarg);
+                break;
+
+            case 'r':
+                rssi = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-s seconds] [-o out.wav] "
+                                "[-e events.txt] [-d debug.txt] "
+                                "[-u payload] [-n noise] [-r rssi]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    if (payload != NULL)
+    {
+        sim_uplink_open(payload, noise, rssi);
+    }
+
+    end = (uint64_t) (seconds * F_CPU);
+
+    sim_time = 0;
+    debug_init();
+    telem_init();
+    ssdv_init(&test_jpeg_source.source);
+    radio_init();
+    sim_irq_deliver();
+
+    /* main.c's RTC tick; the main loop runs between radio interrupts */
+    tick = F_CPU;
+
+    while (sim_timer_running() && sim_timer_next() <= end)
+    {
+        if (tick <= sim_timer_next())
+        {
+            sim_time = tick;
+            sim_monitor_second();
+            monitor_update();
+            telem_update();
+            tick += F_CPU;
+        }
+
+        sim_time = sim_timer_next();
+        sim_timer_fire();
+        radio_refill();
+        ssdv_update();
+    }
+
+    sim_render_advance(end);
+    sim_render_close();
+
+    return 0;
+}
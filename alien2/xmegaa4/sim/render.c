@@ -0,0 +1,158 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../radio/hardware.h"
+#include "sim.h"
+
+/*
+ * Renders the event stream to a 16 bit mono WAV of what an SSB receiver
+ * tuned to the transmitter would hear. The DAC pulls the carrier; going by
+ * rtty.c (MARK - SPACE = 700 LSBs for a 425Hz shift) that's about
+ * 0.607Hz per LSB. DAC value RENDER_DAC_REF is placed at RENDER_AUDIO_REF Hz.
+ *
+ * TXOFF (which on the real thing parks the carrier at IDLE_FREQ, well out
+ * of the receiver's passband), IDLE and RX are all rendered as silence, so
+ * Hell and Morse come out as clean OOK.
+ */
+
+#define RENDER_RATE      48000
+#define RENDER_DAC_REF   2000
+#define RENDER_AUDIO_REF 1000.0
+#define RENDER_HZ_PER_LSB (425.0 / 700.0)
+#define RENDER_AMPLITUDE 16000.0
+
+static FILE *render_file;
+static uint64_t render_samples;
+static uint16_t render_dac;
+static uint8_t render_keyed;
+static double render_phase;
+
+static void write_u16(uint16_t v)
+{
+    fputc(v & 0xFF, render_file);
+    fputc(v >> 8, render_file);
+}
+
+static void write_u32(uint32_t v)
+{
+    write_u16(v & 0xFFFF);
+    write_u16(v >> 16);
+}
+
+static void write_header(uint32_t data_bytes)
+{
+    fwrite("RIFF", 1, 4, render_file);
+    write_u32(36 + data_bytes);
+    fwrite("WAVEfmt ", 1, 8, render_file);
+    write_u32(16);                  /* fmt chunk size */
+    write_u16(1);                   /* PCM */
+    write_u16(1);                   /* mono */
+    write_u32(RENDER_RATE);
+    write_u32(RENDER_RATE * 2);     /* byte rate */
+    write_u16(2);                   /* block align */
+    write_u16(16);                  /* bits per sample */
+    fwrite("data", 1, 4, render_file);
+    write_u32(data_bytes);
+}
+
+uint8_t sim_render_open(FILE *f)
+{
+    render_file = f;
+    render_samples = 0;
+    render_dac = RENDER_DAC_REF;
+    render_keyed = 0;
+    render_phase = 0;
+
+    /* Sizes are patched by sim_render_close, so f must be seekable */
+    write_header(0);
+    return ferror(f) ? 1 : 0;
+}
+
+void sim_render_event(const struct sim_event *e)
+{
+    if (render_file == NULL)
+    {
+        return;
+    }
+
+    sim_render_advance(e->time);
+
+    if (e->type == SIM_EVENT_DAC)
+    {
+        render_dac = e->value;
+    }
+    else if (e->type == SIM_EVENT_MODE)
+    {
+        render_keyed = (e->value == RADIO_HW_MODE_TX);
+    }
+}
+
+/* Emit every sample whose time is before CPU cycle "until" */
+void sim_render_advance(uint64_t until)
+{
+    double step;
+
+    if (render_file == NULL)
+    {
+        return;
+    }
+
+    step = 2 * M_PI * (RENDER_AUDIO_REF +
+           ((int32_t) render_dac - RENDER_DAC_REF) * RENDER_HZ_PER_LSB) /
+           RENDER_RATE;
+
+    while (render_samples * F_CPU / RENDER_RATE < until)
+    {
+        int16_t s;
+
+        if (render_keyed)
+        {
+            s = (int16_t) (sin(render_phase) * RENDER_AMPLITUDE);
+            render_phase += step;
+
+            if (render_phase >= 2 * M_PI)
+            {
+                render_phase -= 2 * M_PI;
+            }
+        }
+        else
+        {
+            s = 0;
+        }
+
+        write_u16((uint16_t) s);
+        render_samples++;
+    }
+}
+
+void sim_render_close()
+{
+    if (render_file == NULL)
+    {
+        return;
+    }
+
+    fflush(render_file);
+    fseek(render_file, 0, SEEK_SET);
+    write_header(render_samples * 2);
+    fclose(render_file);
+    render_file = NULL;
+}
@@ -0,0 +1,67 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SIM_SIM_H__
+#define __SIM_SIM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * The simulator replaces radio/hardware.c with sim/hardware.c, which turns
+ * every radio_hw_* call into a sim_event stamped with the (simulated) CPU
+ * cycle count at which it happened. Events are handed to every listener;
+ * currently that's the text log and the WAV renderer.
+ */
+
+#define SIM_EVENT_DAC    0
+#define SIM_EVENT_TIMER  1
+#define SIM_EVENT_PERBUF 2
+#define SIM_EVENT_MODE   3
+
+struct sim_event
+{
+    uint64_t time;      /* CPU cycles since radio_init */
+    uint8_t type;
+    uint8_t div;        /* SIM_EVENT_TIMER only */
+    uint16_t value;     /* DAC value, timer PER or radio_hw_mode argument */
+};
+
+extern uint64_t sim_time;
+
+uint8_t sim_timer_running();
+uint64_t sim_timer_next();
+void sim_timer_fire();
+void sim_irq_deliver();
+
+void sim_log_open(FILE *f);
+void sim_log_event(const struct sim_event *e);
+
+void sim_debug_open(FILE *f);
+
+void sim_uplink_open(const char *payload, double noise, uint16_t rssi);
+uint16_t sim_uplink_af();
+uint16_t sim_uplink_rssi();
+
+void sim_monitor_second();
+
+uint8_t sim_render_open(FILE *f);
+void sim_render_event(const struct sim_event *e);
+void sim_render_advance(uint64_t until);
+void sim_render_close();
+
+#endif
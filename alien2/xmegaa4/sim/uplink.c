@@ -0,0 +1,156 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+/*
+ * Generates the AF the receiver would hand the ADC while a ground station
+ * sends an uplink frame ($<payload>*<checksum>\n, 8N1 at 50 baud, 300Hz
+ * mark, 500Hz space; see radio/uplink.c) over and over with a second of
+ * mark between each, plus gaussian noise. Without -u the AF is silent.
+ * The RSSI line reads the given value while the ground station sends, and
+ * UPLINK_RSSI_FLOOR (the receiver's own noise) otherwise.
+ */
+
+#define UPLINK_BAUD       50
+#define UPLINK_MARK_HZ    300.0
+#define UPLINK_SPACE_HZ   500.0
+#define UPLINK_AMPLITUDE  200.0
+#define UPLINK_GAP_BITS   UPLINK_BAUD
+#define UPLINK_RSSI_FLOOR 300
+
+static char uplink_text[128];
+static uint16_t uplink_bits;
+static double uplink_noise, uplink_phase;
+static uint16_t uplink_rssi;
+static uint64_t uplink_last;
+
+void sim_uplink_open(const char *payload, double noise, uint16_t rssi)
+{
+    uint8_t checksum;
+    const char *c;
+
+    checksum = 0;
+
+    for (c = payload; *c != '\0'; c++)
+    {
+        checksum ^= *c;
+    }
+
+    snprintf(uplink_text, sizeof(uplink_text), "$%s*%02X\n",
+             payload, checksum);
+
+    uplink_bits = UPLINK_GAP_BITS + strlen(uplink_text) * 10;
+    uplink_noise = noise;
+    uplink_rssi = rssi;
+}
+
+/* Is bit number n of the repeating transmission mark? */
+static uint8_t uplink_bit(uint64_t n)
+{
+    uint16_t b;
+    uint8_t c, i;
+
+    b = n % uplink_bits;
+
+    if (b < UPLINK_GAP_BITS)
+    {
+        return 1;
+    }
+
+    b -= UPLINK_GAP_BITS;
+    c = uplink_text[b / 10];
+    i = b % 10;
+
+    if (i == 0)
+    {
+        return 0;   /* start */
+    }
+    else if (i == 9)
+    {
+        return 1;   /* stop */
+    }
+    else
+    {
+        return (c >> (i - 1)) & 1;
+    }
+}
+
+/* Gaussian, by Box-Muller */
+static double uplink_gauss()
+{
+    double u, v;
+
+    u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+uint16_t sim_uplink_rssi()
+{
+    if (uplink_bits == 0)
+    {
+        return UPLINK_RSSI_FLOOR;
+    }
+
+    return uplink_rssi;
+}
+
+uint16_t sim_uplink_af()
+{
+    double f, a;
+
+    if (uplink_bits == 0)
+    {
+        return 2048;
+    }
+
+    if (uplink_bit(sim_time * UPLINK_BAUD / F_CPU))
+    {
+        f = UPLINK_MARK_HZ;
+    }
+    else
+    {
+        f = UPLINK_SPACE_HZ;
+    }
+
+    /* Phase continuous */
+    uplink_phase += 2 * M_PI * f * (sim_time - uplink_last) / F_CPU;
+    uplink_phase = fmod(uplink_phase, 2 * M_PI);
+    uplink_last = sim_time;
+
+    a = 2048 + UPLINK_AMPLITUDE * sin(uplink_phase) +
+        uplink_noise * uplink_gauss();
+
+    if (a < 0)
+    {
+        a = 0;
+    }
+    else if (a > 4095)
+    {
+        a = 4095;
+    }
+
+    return (uint16_t) a;
+}
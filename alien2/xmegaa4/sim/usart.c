@@ -0,0 +1,55 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../debug/trace.h"
+#include "../debug/usart.h"
+#include "sim.h"
+
+/*
+ * Replaces debug/usart.c: the debug USART is a file, and everything
+ * committed to the trace ring is sent as soon as it's enabled.
+ */
+
+static FILE *debug_file;
+
+void sim_debug_open(FILE *f)
+{
+    debug_file = f;
+}
+
+void usart_init()
+{
+}
+
+void usart_tx_enable()
+{
+    uint8_t *data;
+    uint16_t len;
+
+    while ((len = trace_read_span(&data)) != 0)
+    {
+        if (debug_file != NULL)
+        {
+            fwrite(data, 1, len, debug_file);
+        }
+
+        trace_consume(len);
+    }
+}
@@ -0,0 +1,118 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "rs8.h"
+
+/*
+ * GF(256) antilogs and logs, and the generator polynomial in log form;
+ * made by misc-c/pc/tables/rs8.c. A log of RS8_A0 stands for zero.
+ */
+#define RS8_NN 255
+#define RS8_A0 RS8_NN
+
+static uint8_t rs8_alpha_to[RS8_NN + 1] PROGMEM =
+    "\x01\x02\x04\x08\x10\x20\x40\x80\x87\x89\x95\xad\xdd\x3d\x7a\xf4"
+    "\x6f\xde\x3b\x76\xec\x5f\xbe\xfb\x71\xe2\x43\x86\x8b\x91\xa5\xcd"
+    "\x1d\x3a\x74\xe8\x57\xae\xdb\x31\x62\xc4\x0f\x1e\x3c\x78\xf0\x67"
+    "\xce\x1b\x36\x6c\xd8\x37\x6e\xdc\x3f\x7e\xfc\x7f\xfe\x7b\xf6\x6b"
+    "\xd6\x2b\x56\xac\xdf\x39\x72\xe4\x4f\x9e\xbb\xf1\x65\xca\x13\x26"
+    "\x4c\x98\xb7\xe9\x55\xaa\xd3\x21\x42\x84\x8f\x99\xb5\xed\x5d\xba"
+    "\xf3\x61\xc2\x03\x06\x0c\x18\x30\x60\xc0\x07\x0e\x1c\x38\x70\xe0"
+    "\x47\x8e\x9b\xb1\xe5\x4d\x9a\xb3\xe1\x45\x8a\x93\xa1\xc5\x0d\x1a"
+    "\x34\x68\xd0\x27\x4e\x9c\xbf\xf9\x75\xea\x53\xa6\xcb\x11\x22\x44"
+    "\x88\x97\xa9\xd5\x2d\x5a\xb4\xef\x59\xb2\xe3\x41\x82\x83\x81\x85"
+    "\x8d\x9d\xbd\xfd\x7d\xfa\x73\xe6\x4b\x96\xab\xd1\x25\x4a\x94\xaf"
+    "\xd9\x35\x6a\xd4\x2f\x5e\xbc\xff\x79\xf2\x63\xc6\x0b\x16\x2c\x58"
+    "\xb0\xe7\x49\x92\xa3\xc1\x05\x0a\x14\x28\x50\xa0\xc7\x09\x12\x24"
+    "\x48\x90\xa7\xc9\x15\x2a\x54\xa8\xd7\x29\x52\xa4\xcf\x19\x32\x64"
+    "\xc8\x17\x2e\x5c\xb8\xf7\x69\xd2\x23\x46\x8c\x9f\xb9\xf5\x6d\xda"
+    "\x33\x66\xcc\x1f\x3e\x7c\xf8\x77\xee\x5b\xb6\xeb\x51\xa2\xc3\x00";
+
+static uint8_t rs8_index_of[RS8_NN + 1] PROGMEM =
+    "\xff\x00\x01\x63\x02\xc6\x64\x6a\x03\xcd\xc7\xbc\x65\x7e\x6b\x2a"
+    "\x04\x8d\xce\x4e\xc8\xd4\xbd\xe1\x66\xdd\x7f\x31\x6c\x20\x2b\xf3"
+    "\x05\x57\x8e\xe8\xcf\xac\x4f\x83\xc9\xd9\xd5\x41\xbe\x94\xe2\xb4"
+    "\x67\x27\xde\xf0\x80\xb1\x32\x35\x6d\x45\x21\x12\x2c\x0d\xf4\x38"
+    "\x06\x9b\x58\x1a\x8f\x79\xe9\x70\xd0\xc2\xad\xa8\x50\x75\x84\x48"
+    "\xca\xfc\xda\x8a\xd6\x54\x42\x24\xbf\x98\x95\xf9\xe3\x5e\xb5\x15"
+    "\x68\x61\x28\xba\xdf\x4c\xf1\x2f\x81\xe6\xb2\x3f\x33\xee\x36\x10"
+    "\x6e\x18\x46\xa6\x22\x88\x13\xf7\x2d\xb8\x0e\x3d\xf5\xa4\x39\x3b"
+    "\x07\x9e\x9c\x9d\x59\x9f\x1b\x08\x90\x09\x7a\x1c\xea\xa0\x71\x5a"
+    "\xd1\x1d\xc3\x7b\xae\x0a\xa9\x91\x51\x5b\x76\x72\x85\xa1\x49\xeb"
+    "\xcb\x7c\xfd\xc4\xdb\x1e\x8b\xd2\xd7\x92\x55\xaa\x43\x0b\x25\xaf"
+    "\xc0\x73\x99\x77\x96\x5c\xfa\x52\xe4\xec\x5f\x4a\xb6\xa2\x16\x86"
+    "\x69\xc5\x62\xfe\x29\x7d\xbb\xcc\xe0\xd3\x4d\x8c\xf2\x1f\x30\xdc"
+    "\x82\xab\xe7\x56\xb3\x93\x40\xd8\x34\xb0\xef\x26\x37\x0c\x11\x44"
+    "\x6f\x78\x19\x9a\x47\x74\xa7\xc1\x23\x53\x89\xfb\x14\x5d\xf8\x97"
+    "\x2e\x4b\xb9\x60\x0f\xed\x3e\xe5\xf6\x87\xa5\x17\x3a\xa3\x3c\xb7";
+
+static uint8_t rs8_genpoly[RS8_PARITY_LEN + 1] PROGMEM =
+    "\x00\xf9\x3b\x42\x04\x2b\x7e\xfb\x61\x1e\x03\xd5\x32\x42\xaa\x05"
+    "\x18\x05\xaa\x42\x32\xd5\x03\x1e\x61\xfb\x7e\x2b\x04\x42\x3b\xf9"
+    "\x00";
+
+/* alpha^log, for any log up to 2 * (RS8_NN - 1) */
+static uint8_t rs8_alpha(uint16_t log)
+{
+    if (log >= RS8_NN)
+    {
+        log -= RS8_NN;
+    }
+
+    return pgm_read_byte(&(rs8_alpha_to[log]));
+}
+
+/*
+ * parity is the LFSR: each data byte is fed back through the generator,
+ * and the register shifts along by one.
+ */
+void rs8_encode(const uint8_t *data, uint8_t *parity)
+{
+    uint8_t i, j, feedback, g;
+
+    memset(parity, 0, RS8_PARITY_LEN);
+
+    for (i = 0; i < RS8_DATA_LEN; i++)
+    {
+        feedback = pgm_read_byte(&(rs8_index_of[data[i] ^ parity[0]]));
+
+        if (feedback != RS8_A0)
+        {
+            for (j = 1; j < RS8_PARITY_LEN; j++)
+            {
+                g = pgm_read_byte(&(rs8_genpoly[RS8_PARITY_LEN - j]));
+                parity[j] ^= rs8_alpha(feedback + g);
+            }
+        }
+
+        memmove(&parity[0], &parity[1], RS8_PARITY_LEN - 1);
+
+        if (feedback != RS8_A0)
+        {
+            g = pgm_read_byte(&(rs8_genpoly[0]));
+            parity[RS8_PARITY_LEN - 1] = rs8_alpha(feedback + g);
+        }
+        else
+        {
+            parity[RS8_PARITY_LEN - 1] = 0;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SSDV_RS8_H__
+#define __SSDV_RS8_H__
+
+#include <stdint.h>
+
+#define RS8_PARITY_LEN 32
+#define RS8_DATA_LEN   223
+
+/*
+ * Writes the RS8_PARITY_LEN parity bytes of RS(255,223) for the
+ * RS8_DATA_LEN bytes at data to parity. This is the conventional (not
+ * CCSDS dual basis) form of Phil Karn's encode_rs_8, as SSDV uses.
+ */
+void rs8_encode(const uint8_t *data, uint8_t *parity);
+
+#endif
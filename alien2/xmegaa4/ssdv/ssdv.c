@@ -0,0 +1,1232 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "../data.h"
+#include "../debug/debug.h"
+#include "rs8.h"
+#include "ssdv.h"
+
+/*
+ * An SSDV packet is
+ *
+ *   0       sync, 0x55
+ *   1       type, 0x66 (normal, with FEC)
+ *   2-5     callsign, base 40
+ *   6       image id
+ *   7-8     packet id
+ *   9, 10   width and height / 16
+ *   11      flags: (quality - 4) << 3, end of image << 2, MCU mode
+ *   12      offset of the first MCU that starts in the payload, or 0xFF
+ *   13-14   index of that MCU, or 0xFFFF
+ *   15-219  payload
+ *   220-223 CRC32 of 1-219
+ *   224-255 RS(255,223) parity of 1-223
+ *
+ * all big endian. The payload is the JPEG's entropy coded data, less byte
+ * stuffing and restart markers, and with two changes so that a lost
+ * packet only costs the MCUs in it: the first MCU that starts in each
+ * packet is byte aligned (padded with 1s), and the DC predictors are
+ * reset to 0 there. The ground station puts back the headers: the
+ * standard (JPEG Annex K) Huffman tables, and quantisation tables chosen
+ * by the quality field.
+ *
+ * The JPEG is decoded symbol by symbol, as it's read, and each coefficient
+ * re-encoded straight into the packet, so only the packets are buffered.
+ * That means it has to be baseline, 8 bit, YCbCr with Y sampled 2x2 or
+ * 1x1 and chroma 1x1, a multiple of 16 pixels each way, and Huffman coded
+ * with the standard tables, which is what libjpeg and most cameras
+ * produce anyway. Coefficients are requantised from its quantisation
+ * tables to SSDV quality 4 (the Annex K tables as they are); if it
+ * already uses those, that's a no-op.
+ *
+ * Decoding is bit by bit, from the standard tables in flash (no RAM
+ * lookup tables); with the CRC and parity, a packet takes some tens of
+ * milliseconds, so it's done from the main loop: RTTY calls its source
+ * from its ISR. Packets are double buffered much like telem.c's
+ * sentences, except that each is sent once and then discarded, rather
+ * than repeated until the next is ready.
+ */
+
+#define SSDV_SYNC          0x55
+#define SSDV_TYPE          0x66
+#define SSDV_CALLSIGN      "A2"
+#define SSDV_QUALITY       4
+
+#define SSDV_HEADER_LEN    15
+#define SSDV_PAYLOAD_LEN   205
+#define SSDV_CRC_OFFSET    (SSDV_HEADER_LEN + SSDV_PAYLOAD_LEN)
+#define SSDV_PARITY_OFFSET (SSDV_CRC_OFFSET + 4)
+#define SSDV_NO_MCU        0xFF
+
+/*
+ * The most that one call of ssdv_step can write: three ZRLs, a code and
+ * its extra bits is at most 59 bits, plus 7 left over from last time.
+ */
+#define SSDV_OVERFLOW_LEN  8
+
+#define SSDV_OK            0
+#define SSDV_ERROR         1
+
+#define SSDV_START         0  /* next packet starts a new image */
+#define SSDV_DATA          1
+#define SSDV_FAILED        2
+
+#define JPEG_SOF0          0xC0
+#define JPEG_DHT           0xC4
+#define JPEG_SOF15         0xCF
+#define JPEG_RST0          0xD0
+#define JPEG_RST7          0xD7
+#define JPEG_SOI           0xD8
+#define JPEG_EOI           0xD9
+#define JPEG_SOS           0xDA
+#define JPEG_DQT           0xDB
+#define JPEG_DRI           0xDD
+
+/* Huffman tables are numbered as in a DHT segment: class << 4 | id */
+#define HUFF_AC            0x10
+#define HUFF_ZRL           0xF0
+#define HUFF_EOB           0x00
+
+/* JPEG Annex K, in zigzag order; luminance then chrominance */
+static uint8_t ssdv_std_dqt[2][64] PROGMEM =
+    { { 16, 11, 12, 14, 12, 10, 16, 14, 13, 14, 18, 17, 16, 19, 24, 40,
+        26, 24, 22, 22, 24, 49, 35, 37, 29, 40, 58, 51, 61, 60, 57, 51,
+        56, 55, 64, 72, 92, 78, 64, 68, 87, 69, 55, 56, 80, 109, 81, 87,
+        95, 98, 103, 104, 103, 62, 77, 113, 121, 112, 100, 120, 92, 101,
+        103, 99 },
+      { 17, 18, 18, 24, 21, 24, 47, 26, 26, 47, 99, 66, 56, 66, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+        99 } };
+
+/* The number of codes of each length, 1 to 16, then the symbols */
+static uint8_t ssdv_dc_bits[2][16] PROGMEM =
+    { { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 } };
+static uint8_t ssdv_dc_vals[12] PROGMEM =
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static uint8_t ssdv_ac_bits[2][16] PROGMEM =
+    { { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 125 },
+      { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 119 } };
+static uint8_t ssdv_ac_vals[2][162] PROGMEM =
+    { { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41,
+        0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91,
+        0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24,
+        0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a,
+        0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38,
+        0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53,
+        0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66,
+        0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+        0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93,
+        0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+        0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+        0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2,
+        0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa },
+      { 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12,
+        0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14,
+        0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15,
+        0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17,
+        0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37,
+        0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a,
+        0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65,
+        0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+        0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a,
+        0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+        0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5,
+        0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+        0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+        0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2,
+        0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa } };
+
+static struct data_reader ssdv_jpeg;
+static uint8_t ssdv_status;
+static uint32_t ssdv_callsign;
+static uint8_t ssdv_image_id;
+static uint16_t ssdv_packet_id;
+
+/* From the JPEG's headers */
+static uint8_t ssdv_width, ssdv_height, ssdv_mcu_mode, ssdv_y_blocks;
+static uint16_t ssdv_mcu_count, ssdv_restart_interval;
+static uint8_t ssdv_dqt[2][64];
+static uint8_t ssdv_component_dqt[3], ssdv_component_huff[3];
+
+/* Decoder: the next coefficient is ssdv_coef of ssdv_block of ssdv_mcu */
+static uint8_t ssdv_in_byte, ssdv_in_bits;
+static uint16_t ssdv_mcu;
+static uint8_t ssdv_block, ssdv_coef, ssdv_zeros;
+static int16_t ssdv_in_dc[3], ssdv_out_dc[3];
+
+/*
+ * Encoder. ssdv_out_pos counts whole bytes of payload, and can run past
+ * SSDV_PAYLOAD_LEN into ssdv_overflow, which starts the next packet.
+ */
+static uint8_t *ssdv_pkt;
+static uint8_t ssdv_out_pos, ssdv_out_byte, ssdv_out_bits;
+static uint8_t ssdv_overflow[SSDV_OVERFLOW_LEN];
+static uint8_t ssdv_mcu_offset;
+static uint16_t ssdv_mcu_index;
+
+static uint8_t ssdv_buffers[2][SSDV_PKT_SIZE];
+static uint8_t *volatile ssdv_ready;
+/* NULL between packets */
+static uint8_t *volatile ssdv_reading;
+static uint8_t ssdv_half;
+
+static uint8_t ssdv_next(struct data_source *source,
+                         struct data_span *span);
+static uint8_t ssdv_render(uint8_t *pkt);
+static void ssdv_fail();
+static uint8_t ssdv_start();
+static void ssdv_end();
+static uint8_t ssdv_step();
+static uint8_t ssdv_dc(uint8_t c);
+static uint8_t ssdv_ac(uint8_t c);
+static void ssdv_end_block();
+static int16_t ssdv_requant(int16_t v, uint8_t c, uint8_t k);
+static uint8_t ssdv_restart();
+static uint8_t ssdv_read(uint8_t *b);
+static uint8_t ssdv_read_uint16(uint16_t *v);
+static uint8_t ssdv_skip(uint16_t len);
+static uint8_t ssdv_read_sof(uint16_t len);
+static uint8_t ssdv_read_dht(uint16_t len);
+static uint8_t ssdv_read_dqt(uint16_t len);
+static uint8_t ssdv_read_sos(uint16_t len);
+static uint8_t ssdv_get_bit(uint8_t *bit);
+static uint8_t ssdv_get_value(uint8_t size, int16_t *v);
+static uint8_t ssdv_decode(uint8_t table, uint8_t *symbol);
+static void ssdv_encode(uint8_t table, uint8_t symbol);
+static void ssdv_put_value(uint8_t table, uint8_t run, int16_t v);
+static void ssdv_put_bits(uint16_t bits, uint8_t n);
+static void ssdv_put_byte(uint8_t b);
+static void ssdv_flush();
+static const uint8_t *ssdv_huff_bits(uint8_t table);
+static const uint8_t *ssdv_huff_vals(uint8_t table);
+static uint32_t ssdv_crc32(const uint8_t *data, uint8_t len);
+static uint32_t ssdv_encode_callsign(const char *callsign);
+
+struct data_source ssdv_source = { ssdv_next };
+
+void ssdv_init(struct data_source *jpeg)
+{
+    data_reader_start(&ssdv_jpeg, jpeg);
+    ssdv_callsign = ssdv_encode_callsign(SSDV_CALLSIGN);
+    ssdv_status = SSDV_START;
+
+    if (ssdv_render(ssdv_buffers[0]) == SSDV_OK)
+    {
+        ssdv_ready = ssdv_buffers[0];
+    }
+}
+
+void ssdv_update()
+{
+    uint8_t *back, *ready;
+
+    cli();
+    ready = ssdv_ready;
+
+    if (ssdv_reading == ssdv_buffers[0])
+    {
+        back = ssdv_buffers[1];
+    }
+    else
+    {
+        back = ssdv_buffers[0];
+    }
+
+    sei();
+
+    if (ready != NULL || ssdv_render(back) != SSDV_OK)
+    {
+        return;
+    }
+
+    cli();
+    ssdv_ready = back;
+    sei();
+}
+
+/* A packet is two spans, since a span is at most 255 bytes */
+static uint8_t ssdv_next(struct data_source *source,
+                         struct data_span *span)
+{
+    if (ssdv_reading == NULL)
+    {
+        if (ssdv_ready == NULL)
+        {
+            return DATA_SOURCE_FINISHED;
+        }
+
+        ssdv_reading = ssdv_ready;
+        ssdv_ready = NULL;
+        ssdv_half = 0;
+    }
+
+    if (ssdv_half == 2)
+    {
+        ssdv_reading = NULL;
+        return DATA_SOURCE_FINISHED;
+    }
+
+    span->data = ssdv_reading + (ssdv_half * (SSDV_PKT_SIZE / 2));
+    span->len = SSDV_PKT_SIZE / 2;
+    span->flags = DATA_SPAN_RAM;
+    ssdv_half++;
+    return DATA_SOURCE_OK;
+}
+
+uint8_t ssdv_fresh()
+{
+    return (ssdv_ready != NULL);
+}
+
+uint16_t ssdv_length()
+{
+    if (ssdv_ready == NULL)
+    {
+        return 0;
+    }
+    else
+    {
+        return SSDV_PKT_SIZE;
+    }
+}
+
+static uint8_t ssdv_render(uint8_t *pkt)
+{
+    uint8_t n, eoi;
+    uint32_t crc;
+
+    if (ssdv_status == SSDV_FAILED)
+    {
+        return SSDV_ERROR;
+    }
+
+    if (ssdv_status == SSDV_START)
+    {
+        if (ssdv_start() != SSDV_OK)
+        {
+            ssdv_fail();
+            return SSDV_ERROR;
+        }
+
+        ssdv_status = SSDV_DATA;
+    }
+
+    ssdv_pkt = pkt;
+    ssdv_mcu_offset = SSDV_NO_MCU;
+    ssdv_mcu_index = 0xFFFF;
+
+    /* Whatever didn't fit in the last packet */
+    n = ssdv_out_pos - SSDV_PAYLOAD_LEN;
+    memcpy(pkt + SSDV_HEADER_LEN, ssdv_overflow, n);
+    ssdv_out_pos = n;
+
+    while (ssdv_out_pos < SSDV_PAYLOAD_LEN && ssdv_mcu < ssdv_mcu_count)
+    {
+        if (ssdv_step() != SSDV_OK)
+        {
+            ssdv_fail();
+            return SSDV_ERROR;
+        }
+    }
+
+    eoi = 0;
+
+    if (ssdv_mcu == ssdv_mcu_count &&
+        ssdv_out_pos + (ssdv_out_bits != 0) <= SSDV_PAYLOAD_LEN)
+    {
+        ssdv_end();
+        eoi = 1;
+    }
+
+    pkt[0] = SSDV_SYNC;
+    pkt[1] = SSDV_TYPE;
+    pkt[2] = ssdv_callsign >> 24;
+    pkt[3] = ssdv_callsign >> 16;
+    pkt[4] = ssdv_callsign >> 8;
+    pkt[5] = ssdv_callsign;
+    pkt[6] = ssdv_image_id;
+    pkt[7] = ssdv_packet_id >> 8;
+    pkt[8] = ssdv_packet_id;
+    pkt[9] = ssdv_width;
+    pkt[10] = ssdv_height;
+    pkt[11] = (((SSDV_QUALITY - 4) & 0x07) << 3) | (eoi << 2) |
+              ssdv_mcu_mode;
+    pkt[12] = ssdv_mcu_offset;
+    pkt[13] = ssdv_mcu_index >> 8;
+    pkt[14] = ssdv_mcu_index;
+
+    crc = ssdv_crc32(pkt + 1, SSDV_CRC_OFFSET - 1);
+    pkt[SSDV_CRC_OFFSET] = crc >> 24;
+    pkt[SSDV_CRC_OFFSET + 1] = crc >> 16;
+    pkt[SSDV_CRC_OFFSET + 2] = crc >> 8;
+    pkt[SSDV_CRC_OFFSET + 3] = crc;
+
+    rs8_encode(pkt + 1, pkt + SSDV_PARITY_OFFSET);
+
+    ssdv_packet_id++;
+
+    if (eoi)
+    {
+        ssdv_image_id++;
+        ssdv_status = SSDV_START;
+    }
+
+    return SSDV_OK;
+}
+
+/* Stop for good: trying again would just fail again */
+static void ssdv_fail()
+{
+    uint8_t b;
+
+    debug_es("SSDV: unsupported or corrupt JPEG\n");
+
+    while (data_reader_byte(&ssdv_jpeg, &b) == DATA_SOURCE_OK);
+
+    ssdv_status = SSDV_FAILED;
+}
+
+/* Reads the headers, up to and including SOS */
+static uint8_t ssdv_start()
+{
+    uint8_t b, marker;
+    uint16_t len;
+
+    ssdv_mcu_count = 0;
+    ssdv_restart_interval = 0;
+
+    for (;;)
+    {
+        if (ssdv_read(&b) != SSDV_OK || b != 0xFF)
+        {
+            return SSDV_ERROR;
+        }
+
+        /* Any number of 0xFFs may come before a marker */
+        do
+        {
+            if (ssdv_read(&marker) != SSDV_OK)
+            {
+                return SSDV_ERROR;
+            }
+        }
+        while (marker == 0xFF);
+
+        if (marker == JPEG_SOI)
+        {
+            continue;
+        }
+
+        if (marker == JPEG_EOI || ssdv_read_uint16(&len) != SSDV_OK ||
+            len < 2)
+        {
+            return SSDV_ERROR;
+        }
+
+        len -= 2;
+
+        if (marker == JPEG_SOF0)
+        {
+            b = ssdv_read_sof(len);
+        }
+        else if (marker == JPEG_DHT)
+        {
+            b = ssdv_read_dht(len);
+        }
+        else if (marker > JPEG_SOF0 && marker <= JPEG_SOF15)
+        {
+            /* Progressive, arithmetic coded, ... */
+            return SSDV_ERROR;
+        }
+        else if (marker == JPEG_DQT)
+        {
+            b = ssdv_read_dqt(len);
+        }
+        else if (marker == JPEG_DRI)
+        {
+            b = ssdv_read_uint16(&ssdv_restart_interval);
+        }
+        else if (marker == JPEG_SOS)
+        {
+            break;
+        }
+        else
+        {
+            /* APPn, COM, etc. */
+            b = ssdv_skip(len);
+        }
+
+        if (b != SSDV_OK)
+        {
+            return SSDV_ERROR;
+        }
+    }
+
+    if (ssdv_mcu_count == 0 || ssdv_read_sos(len) != SSDV_OK)
+    {
+        return SSDV_ERROR;
+    }
+
+    ssdv_in_bits = 0;
+    ssdv_mcu = 0;
+    ssdv_block = 0;
+    ssdv_coef = 0;
+    ssdv_zeros = 0;
+    memset(ssdv_in_dc, 0, sizeof(ssdv_in_dc));
+
+    /* As if the last packet was exactly full */
+    ssdv_out_bits = 0;
+    ssdv_out_pos = SSDV_PAYLOAD_LEN;
+    ssdv_packet_id = 0;
+
+    return SSDV_OK;
+}
+
+/*
+ * The last MCU has been read: the rest of the input is just EOI. Pad the
+ * payload out with 1s.
+ */
+static void ssdv_end()
+{
+    uint8_t b;
+
+    while (data_reader_byte(&ssdv_jpeg, &b) == DATA_SOURCE_OK);
+
+    ssdv_flush();
+
+    while (ssdv_out_pos < SSDV_PAYLOAD_LEN)
+    {
+        ssdv_put_byte(0xFF);
+    }
+}
+
+/* Reads one symbol (and its extra bits) and writes what it becomes */
+static uint8_t ssdv_step()
+{
+    uint8_t c;
+
+    if (ssdv_block == 0 && ssdv_coef == 0)
+    {
+        if (ssdv_mcu_offset == SSDV_NO_MCU)
+        {
+            ssdv_flush();
+
+            /* If that filled the packet, this MCU starts the next one */
+            if (ssdv_out_pos >= SSDV_PAYLOAD_LEN)
+            {
+                return SSDV_OK;
+            }
+
+            ssdv_mcu_offset = ssdv_out_pos;
+            ssdv_mcu_index = ssdv_mcu;
+            memset(ssdv_out_dc, 0, sizeof(ssdv_out_dc));
+        }
+
+        if (ssdv_restart_interval != 0 && ssdv_mcu != 0 &&
+            ssdv_mcu % ssdv_restart_interval == 0 &&
+            ssdv_restart() != SSDV_OK)
+        {
+            return SSDV_ERROR;
+        }
+    }
+
+    if (ssdv_block < ssdv_y_blocks)
+    {
+        c = 0;
+    }
+    else
+    {
+        c = ssdv_block - ssdv_y_blocks + 1;
+    }
+
+    if (ssdv_coef == 0)
+    {
+        return ssdv_dc(c);
+    }
+    else
+    {
+        return ssdv_ac(c);
+    }
+}
+
+/*
+ * DC is coded as the difference from the last block of the component.
+ * Work out the absolute value, then the difference from what we sent.
+ */
+static uint8_t ssdv_dc(uint8_t c)
+{
+    uint8_t size;
+    int16_t v;
+
+    if (ssdv_decode(ssdv_component_huff[c] >> 4, &size) != SSDV_OK ||
+        size > 11 || ssdv_get_value(size, &v) != SSDV_OK)
+    {
+        return SSDV_ERROR;
+    }
+
+    ssdv_in_dc[c] += v;
+    v = ssdv_requant(ssdv_in_dc[c], c, 0);
+
+    ssdv_put_value(c == 0 ? 0 : 1, 0, v - ssdv_out_dc[c]);
+    ssdv_out_dc[c] = v;
+
+    ssdv_coef = 1;
+    return SSDV_OK;
+}
+
+/*
+ * Requantising can turn a coefficient into zero, so the output's run of
+ * zeros (ssdv_zeros) is counted separately, and written out with the next
+ * non zero coefficient, or dropped if an EOB comes first.
+ */
+static uint8_t ssdv_ac(uint8_t c)
+{
+    uint8_t symbol, run, size, table;
+    int16_t v;
+
+    if (ssdv_decode(HUFF_AC | (ssdv_component_huff[c] & 0x0F),
+                    &symbol) != SSDV_OK)
+    {
+        return SSDV_ERROR;
+    }
+
+    table = HUFF_AC | (c == 0 ? 0 : 1);
+    run = symbol >> 4;
+    size = symbol & 0x0F;
+
+    if (symbol == HUFF_EOB)
+    {
+        ssdv_encode(table, HUFF_EOB);
+        ssdv_end_block();
+        return SSDV_OK;
+    }
+
+    ssdv_coef += run;
+    ssdv_zeros += run;
+
+    if (symbol == HUFF_ZRL)
+    {
+        ssdv_coef++;
+        ssdv_zeros++;
+    }
+    else
+    {
+        if (ssdv_coef > 63 || size > 10 ||
+            ssdv_get_value(size, &v) != SSDV_OK)
+        {
+            return SSDV_ERROR;
+        }
+
+        v = ssdv_requant(v, c, ssdv_coef);
+
+        if (v == 0)
+        {
+            ssdv_zeros++;
+        }
+        else
+        {
+            while (ssdv_zeros >= 16)
+            {
+                ssdv_encode(table, HUFF_ZRL);
+                ssdv_zeros -= 16;
+            }
+
+            ssdv_put_value(table, ssdv_zeros, v);
+            ssdv_zeros = 0;
+        }
+
+        ssdv_coef++;
+    }
+
+    if (ssdv_coef > 64)
+    {
+        return SSDV_ERROR;
+    }
+
+    if (ssdv_coef == 64)
+    {
+        if (ssdv_zeros != 0)
+        {
+            ssdv_encode(table, HUFF_EOB);
+        }
+
+        ssdv_end_block();
+    }
+
+    return SSDV_OK;
+}
+
+static void ssdv_end_block()
+{
+    ssdv_coef = 0;
+    ssdv_zeros = 0;
+    ssdv_block++;
+
+    if (ssdv_block == ssdv_y_blocks + 2)
+    {
+        ssdv_block = 0;
+        ssdv_mcu++;
+    }
+}
+
+/*
+ * Coefficient k (zigzag order) of component c, from the JPEG's
+ * quantisation to SSDV's, rounded to nearest
+ */
+static int16_t ssdv_requant(int16_t v, uint8_t c, uint8_t k)
+{
+    uint8_t from, to;
+    int32_t x;
+
+    from = ssdv_dqt[ssdv_component_dqt[c]][k];
+    to = pgm_read_byte(&(ssdv_std_dqt[c == 0 ? 0 : 1][k]));
+
+    if (from == to)
+    {
+        return v;
+    }
+
+    x = (int32_t) v * from;
+
+    if (x < 0)
+    {
+        x = -((-x + (to / 2)) / to);
+    }
+    else
+    {
+        x = (x + (to / 2)) / to;
+    }
+
+    /* Keep within 10 bits, so DC differences fit in 11 */
+    if (x > 1023)
+    {
+        x = 1023;
+    }
+    else if (x < -1023)
+    {
+        x = -1023;
+    }
+
+    return x;
+}
+
+/* RSTn: the entropy coded data restarts on a byte boundary */
+static uint8_t ssdv_restart()
+{
+    uint8_t b;
+
+    ssdv_in_bits = 0;
+    memset(ssdv_in_dc, 0, sizeof(ssdv_in_dc));
+
+    if (ssdv_read(&b) != SSDV_OK || b != 0xFF ||
+        ssdv_read(&b) != SSDV_OK || b < JPEG_RST0 || b > JPEG_RST7)
+    {
+        return SSDV_ERROR;
+    }
+
+    return SSDV_OK;
+}
+
+static uint8_t ssdv_read(uint8_t *b)
+{
+    if (data_reader_byte(&ssdv_jpeg, b) != DATA_SOURCE_OK)
+    {
+        return SSDV_ERROR;
+    }
+
+    return SSDV_OK;
+}
+
+static uint8_t ssdv_read_uint16(uint16_t *v)
+{
+    uint8_t hi, lo;
+
+    if (ssdv_read(&hi) != SSDV_OK || ssdv_read(&lo) != SSDV_OK)
+    {
+        return SSDV_ERROR;
+    }
+
+    *v = (hi << 8) | lo;
+    return SSDV_OK;
+}
+
+static uint8_t ssdv_skip(uint16_t len)
+{
+    uint8_t b;
+
+    while (len != 0)
+    {
+        if (ssdv_read(&b) != SSDV_OK)
+        {
+            return SSDV_ERROR;
+        }
+
+        len--;
+    }
+
+    return SSDV_OK;
+}
+
+/* Frame header: dimensions and sampling */
+static uint8_t ssdv_read_sof(uint16_t len)
+{
+    uint8_t precision, n, c, id, sampling, tq;
+    uint16_t height, width;
+
+    if (len != 15 || ssdv_read(&precision) != SSDV_OK ||
+        ssdv_read_uint16(&height) != SSDV_OK ||
+        ssdv_read_uint16(&width) != SSDV_OK ||
+        ssdv_read(&n) != SSDV_OK)
+    {
+        return SSDV_ERROR;
+    }
+
+    if (precision != 8 || n != 3 || height == 0 || width == 0 ||
+        height % 16 != 0 || width % 16 != 0 ||
+        height > 255 * 16 || width > 255 * 16)
+    {
+        return SSDV_ERROR;
+    }
+
+    ssdv_width = width / 16;
+    ssdv_height = height / 16;
+
+    for (c = 0; c < 3; c++)
+    {
+        if (ssdv_read(&id) != SSDV_OK || ssdv_read(&sampling) != SSDV_OK ||
+            ssdv_read(&tq) != SSDV_OK || tq > 1)
+        {
+            return SSDV_ERROR;
+        }
+
+        ssdv_component_dqt[c] = tq;
+
+        if (c == 0 && sampling == 0x22)
+        {
+            ssdv_mcu_mode = 0;
+            ssdv_y_blocks = 4;
+            ssdv_mcu_count = ssdv_width * ssdv_height;
+        }
+        else if (c == 0 && sampling == 0x11)
+        {
+            ssdv_mcu_mode = 3;
+            ssdv_y_blocks = 1;
+            ssdv_mcu_count = (ssdv_width * 2) * (ssdv_height * 2);
+        }
+        else if (c == 0 || sampling != 0x11)
+        {
+            return SSDV_ERROR;
+        }
+    }
+
+    return SSDV_OK;
+}
+
+/* Only the standard tables will do; see above */
+static uint8_t ssdv_read_dht(uint16_t len)
+{
+    uint8_t table, b, i;
+    uint16_t n;
+    const uint8_t *bits, *vals;
+
+    while (len != 0)
+    {
+        if (ssdv_read(&table) != SSDV_OK || (table & ~HUFF_AC) > 1 ||
+            len < 17)
+        {
+            return SSDV_ERROR;
+        }
+
+        bits = ssdv_huff_bits(table);
+        vals = ssdv_huff_vals(table);
+        n = 0;
+
+        for (i = 0; i < 16; i++)
+        {
+            if (ssdv_read(&b) != SSDV_OK ||
+                b != pgm_read_byte(&(bits[i])))
+            {
+                return SSDV_ERROR;
+            }
+
+            n += b;
+        }
+
+        len -= 17;
+
+        if (len < n)
+        {
+            return SSDV_ERROR;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            if (ssdv_read(&b) != SSDV_OK ||
+                b != pgm_read_byte(&(vals[i])))
+            {
+                return SSDV_ERROR;
+            }
+        }
+
+        len -= n;
+    }
+
+    return SSDV_OK;
+}
+
+static uint8_t ssdv_read_dqt(uint16_t len)
+{
+    uint8_t table, i;
+
+    while (len != 0)
+    {
+        /* 8 bit precision, and tables 0 or 1 */
+        if (len < 65 || ssdv_read(&table) != SSDV_OK || table > 1)
+        {
+            return SSDV_ERROR;
+        }
+
+        for (i = 0; i < 64; i++)
+        {
+            if (ssdv_read(&(ssdv_dqt[table][i])) != SSDV_OK ||
+                ssdv_dqt[table][i] == 0)
+            {
+                return SSDV_ERROR;
+            }
+        }
+
+        len -= 65;
+    }
+
+    return SSDV_OK;
+}
+
+/* Scan header: which Huffman tables each component uses */
+static uint8_t ssdv_read_sos(uint16_t len)
+{
+    uint8_t n, c, id, tables, ss, se, a;
+
+    if (len != 10 || ssdv_read(&n) != SSDV_OK || n != 3)
+    {
+        return SSDV_ERROR;
+    }
+
+    for (c = 0; c < 3; c++)
+    {
+        if (ssdv_read(&id) != SSDV_OK || ssdv_read(&tables) != SSDV_OK ||
+            (tables & 0xEE) != 0)
+        {
+            return SSDV_ERROR;
+        }
+
+        ssdv_component_huff[c] = tables;
+    }
+
+    if (ssdv_read(&ss) != SSDV_OK || ssdv_read(&se) != SSDV_OK ||
+        ssdv_read(&a) != SSDV_OK || ss != 0 || se != 63 || a != 0)
+    {
+        return SSDV_ERROR;
+    }
+
+    return SSDV_OK;
+}
+
+/* A bit of entropy coded data; 0xFF is followed by a stuffed 0x00 */
+static uint8_t ssdv_get_bit(uint8_t *bit)
+{
+    uint8_t b;
+
+    if (ssdv_in_bits == 0)
+    {
+        if (ssdv_read(&ssdv_in_byte) != SSDV_OK)
+        {
+            return SSDV_ERROR;
+        }
+
+        if (ssdv_in_byte == 0xFF &&
+            (ssdv_read(&b) != SSDV_OK || b != 0x00))
+        {
+            return SSDV_ERROR;
+        }
+
+        ssdv_in_bits = 8;
+    }
+
+    ssdv_in_bits--;
+    *bit = (ssdv_in_byte >> ssdv_in_bits) & 0x01;
+    return SSDV_OK;
+}
+
+/* size extra bits: the value, where those starting 0 are negative */
+static uint8_t ssdv_get_value(uint8_t size, int16_t *v)
+{
+    uint8_t i, bit;
+    int16_t x;
+
+    x = 0;
+
+    for (i = 0; i < size; i++)
+    {
+        if (ssdv_get_bit(&bit) != SSDV_OK)
+        {
+            return SSDV_ERROR;
+        }
+
+        x = (x << 1) | bit;
+    }
+
+    if (size != 0 && x < (1 << (size - 1)))
+    {
+        x -= (1 << size) - 1;
+    }
+
+    *v = x;
+    return SSDV_OK;
+}
+
+/*
+ * Codes of each length are consecutive, starting at first, which is
+ * (first + count) << 1 of the length before.
+ */
+static uint8_t ssdv_decode(uint8_t table, uint8_t *symbol)
+{
+    const uint8_t *bits, *vals;
+    uint16_t code, first;
+    uint8_t len, index, count, bit;
+
+    bits = ssdv_huff_bits(table);
+    vals = ssdv_huff_vals(table);
+    code = 0;
+    first = 0;
+    index = 0;
+
+    for (len = 0; len < 16; len++)
+    {
+        if (ssdv_get_bit(&bit) != SSDV_OK)
+        {
+            return SSDV_ERROR;
+        }
+
+        code = (code << 1) | bit;
+        count = pgm_read_byte(&(bits[len]));
+
+        if (code - first < count)
+        {
+            *symbol = pgm_read_byte(&(vals[index + (code - first)]));
+            return SSDV_OK;
+        }
+
+        index += count;
+        first = (first + count) << 1;
+    }
+
+    return SSDV_ERROR;
+}
+
+static void ssdv_encode(uint8_t table, uint8_t symbol)
+{
+    const uint8_t *bits, *vals;
+    uint16_t code;
+    uint8_t len, index, count, i;
+
+    bits = ssdv_huff_bits(table);
+    vals = ssdv_huff_vals(table);
+    code = 0;
+    index = 0;
+
+    for (len = 1; len <= 16; len++)
+    {
+        count = pgm_read_byte(&(bits[len - 1]));
+
+        for (i = 0; i < count; i++)
+        {
+            if (pgm_read_byte(&(vals[index + i])) == symbol)
+            {
+                ssdv_put_bits(code + i, len);
+                return;
+            }
+        }
+
+        index += count;
+        code = (code + count) << 1;
+    }
+}
+
+/* A run of zeros then v (or just v, for DC) */
+static void ssdv_put_value(uint8_t table, uint8_t run, int16_t v)
+{
+    uint8_t size;
+    uint16_t a;
+
+    a = (v < 0 ? -v : v);
+    size = 0;
+
+    while (a != 0)
+    {
+        size++;
+        a >>= 1;
+    }
+
+    ssdv_encode(table, (run << 4) | size);
+
+    if (v < 0)
+    {
+        v--;
+    }
+
+    ssdv_put_bits(v, size);
+}
+
+static void ssdv_put_bits(uint16_t bits, uint8_t n)
+{
+    while (n != 0)
+    {
+        n--;
+        ssdv_out_byte = (ssdv_out_byte << 1) | ((bits >> n) & 0x01);
+        ssdv_out_bits++;
+
+        if (ssdv_out_bits == 8)
+        {
+            ssdv_put_byte(ssdv_out_byte);
+            ssdv_out_bits = 0;
+        }
+    }
+}
+
+static void ssdv_put_byte(uint8_t b)
+{
+    if (ssdv_out_pos < SSDV_PAYLOAD_LEN)
+    {
+        ssdv_pkt[SSDV_HEADER_LEN + ssdv_out_pos] = b;
+    }
+    else
+    {
+        ssdv_overflow[ssdv_out_pos - SSDV_PAYLOAD_LEN] = b;
+    }
+
+    ssdv_out_pos++;
+}
+
+/* Pad to a byte boundary with 1s */
+static void ssdv_flush()
+{
+    if (ssdv_out_bits != 0)
+    {
+        ssdv_put_bits(0xFF, 8 - ssdv_out_bits);
+    }
+}
+
+static const uint8_t *ssdv_huff_bits(uint8_t table)
+{
+    if (table & HUFF_AC)
+    {
+        return ssdv_ac_bits[table & 0x01];
+    }
+    else
+    {
+        return ssdv_dc_bits[table & 0x01];
+    }
+}
+
+static const uint8_t *ssdv_huff_vals(uint8_t table)
+{
+    if (table & HUFF_AC)
+    {
+        return ssdv_ac_vals[table & 0x01];
+    }
+    else
+    {
+        return ssdv_dc_vals;
+    }
+}
+
+/* The usual (zlib, PNG) CRC32 */
+static uint32_t ssdv_crc32(const uint8_t *data, uint8_t len)
+{
+    uint32_t crc;
+    uint8_t i;
+
+    crc = 0xFFFFFFFF;
+
+    while (len != 0)
+    {
+        crc ^= *data;
+
+        for (i = 0; i < 8; i++)
+        {
+            if (crc & 0x01)
+            {
+                crc = (crc >> 1) ^ 0xEDB88320;
+            }
+            else
+            {
+                crc >>= 1;
+            }
+        }
+
+        data++;
+        len--;
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+/*
+ * Up to 6 characters, last first, in base 40: 0 is padding, then 0-9 and
+ * A-Z (upper or lower case); anything else is also 0.
+ */
+static uint32_t ssdv_encode_callsign(const char *callsign)
+{
+    uint32_t x;
+    uint8_t n;
+
+    for (n = 0; n < 6 && callsign[n] != '\0'; n++);
+
+    x = 0;
+
+    while (n != 0)
+    {
+        n--;
+        x *= 40;
+
+        if (callsign[n] >= 'A' && callsign[n] <= 'Z')
+        {
+            x += callsign[n] - 'A' + 14;
+        }
+        else if (callsign[n] >= 'a' && callsign[n] <= 'z')
+        {
+            x += callsign[n] - 'a' + 14;
+        }
+        else if (callsign[n] >= '0' && callsign[n] <= '9')
+        {
+            x += callsign[n] - '0' + 1;
+        }
+    }
+
+    return x;
+}
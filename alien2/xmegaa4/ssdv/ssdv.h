@@ -0,0 +1,44 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SSDV_SSDV_H__
+#define __SSDV_SSDV_H__
+
+#include <stdint.h>
+#include "../data.h"
+
+#define SSDV_PKT_SIZE 256
+
+/*
+ * Turns a baseline JPEG, read from jpeg, into SSDV packets. ssdv_init must
+ * be called before interrupts are enabled; it renders the first packet.
+ * After that, ssdv_update renders the next packet once the last has been
+ * taken, and should be called from outside of any ISR. ssdv_source serves
+ * a packet to the radio (or finishes straight away if none is ready),
+ * ssdv_fresh says whether one is, and ssdv_length how long it is.
+ *
+ * jpeg should finish at the end of the image, and then start it again (or
+ * start a new one).
+ */
+extern struct data_source ssdv_source;
+
+void ssdv_init(struct data_source *jpeg);
+void ssdv_update();
+uint8_t ssdv_fresh();
+uint16_t ssdv_length();
+
+#endif
@@ -0,0 +1,147 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <avr/interrupt.h>
+
+#include "monitor.h"
+
+/*
+ * Each channel goes through a boxcar (a one stage CIC) decimator: the sum
+ * of MONITOR_DECIMATE samples is one value, at RADIO_HW_MONITOR_HZ / 16
+ * (125Hz). It is 16 times the mean ADC count; with the noise on the input
+ * to dither it, about two bits finer than a single sample. For the second
+ * stage, each value goes into a sum, a sum of squares and a min and max,
+ * which monitor_update takes and resets once a second. The mean, min and
+ * max are of the decimated values, so have the same resolution, and the
+ * variance is that of the decimated values about their mean.
+ *
+ * monitor_sample runs in an ISR, and only adds: the divisions are done by
+ * monitor_update. The RTC that calls it isn't synchronised to the sample
+ * timer, so the number of values in a second is counted rather than
+ * assumed.
+ */
+#define MONITOR_DECIMATE 16
+
+struct monitor_acc
+{
+    uint16_t boxcar;
+    uint16_t min, max;
+    uint32_t sum;
+    uint64_t squares;
+};
+
+struct monitor_stats monitor_stats[MONITOR_CHANNELS];
+
+static struct monitor_acc monitor_accs[MONITOR_CHANNELS];
+static uint8_t monitor_phase;
+static uint16_t monitor_count;
+
+static void monitor_decimated(struct monitor_acc *acc);
+static void monitor_stats_from(struct monitor_stats *stats,
+                               const struct monitor_acc *acc, uint16_t n);
+
+void monitor_sample(uint16_t rssi, uint16_t supply)
+{
+    monitor_accs[MONITOR_RSSI].boxcar += rssi;
+    monitor_accs[MONITOR_SUPPLY].boxcar += supply;
+    monitor_phase++;
+
+    if (monitor_phase == MONITOR_DECIMATE)
+    {
+        monitor_phase = 0;
+        monitor_decimated(&monitor_accs[MONITOR_RSSI]);
+        monitor_decimated(&monitor_accs[MONITOR_SUPPLY]);
+        monitor_count++;
+    }
+}
+
+static void monitor_decimated(struct monitor_acc *acc)
+{
+    uint16_t value;
+
+    value = acc->boxcar;
+    acc->boxcar = 0;
+
+    if (monitor_count == 0 || value < acc->min)
+    {
+        acc->min = value;
+    }
+
+    if (monitor_count == 0 || value > acc->max)
+    {
+        acc->max = value;
+    }
+
+    acc->sum += value;
+    acc->squares += (uint32_t) value * value;
+}
+
+/*
+ * A second with no values in it reads all zeros. The min and max start
+ * again from the first value after monitor_count is reset, and the boxcar
+ * that is part way through carries on into the next second.
+ */
+void monitor_update()
+{
+    struct monitor_acc accs[MONITOR_CHANNELS];
+    uint16_t n;
+    uint8_t i;
+
+    cli();
+
+    n = monitor_count;
+    monitor_count = 0;
+
+    for (i = 0; i < MONITOR_CHANNELS; i++)
+    {
+        accs[i] = monitor_accs[i];
+        monitor_accs[i].sum = 0;
+        monitor_accs[i].squares = 0;
+    }
+
+    sei();
+
+    for (i = 0; i < MONITOR_CHANNELS; i++)
+    {
+        monitor_stats_from(&monitor_stats[i], &accs[i], n);
+    }
+}
+
+static void monitor_stats_from(struct monitor_stats *stats,
+                               const struct monitor_acc *acc, uint16_t n)
+{
+    uint64_t sum;
+
+    if (n == 0)
+    {
+        stats->mean = 0;
+        stats->min = 0;
+        stats->max = 0;
+        stats->variance = 0;
+        return;
+    }
+
+    sum = acc->sum;
+
+    stats->mean = (sum + (n / 2)) / n;
+    stats->min = acc->min;
+    stats->max = acc->max;
+
+    /* (sum of squares - sum^2 / n) / n; can't go negative */
+    stats->variance = (acc->squares - ((sum * sum) / n)) / n;
+}
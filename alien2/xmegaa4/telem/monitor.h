@@ -0,0 +1,48 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TELEM_MONITOR_H__
+#define __TELEM_MONITOR_H__
+
+#include <stdint.h>
+
+/*
+ * Background monitoring of the RSSI and supply lines (see
+ * radio/hardware.c). monitor_sample is given each pair of raw ADC
+ * readings, RADIO_HW_MONITOR_HZ times a second, from a low level ISR.
+ * monitor_update should be called once a second from outside of any ISR;
+ * it sums up the samples since it was last called into monitor_stats.
+ *
+ * Every value is in 1/16ths of an ADC count (0 to 65520) and the
+ * variance in 1/256ths of a count squared; see monitor.c.
+ */
+#define MONITOR_RSSI     0
+#define MONITOR_SUPPLY   1
+#define MONITOR_CHANNELS 2
+
+struct monitor_stats
+{
+    uint16_t mean, min, max;
+    uint32_t variance;
+};
+
+extern struct monitor_stats monitor_stats[MONITOR_CHANNELS];
+
+void monitor_sample(uint16_t rssi, uint16_t supply);
+void monitor_update();
+
+#endif
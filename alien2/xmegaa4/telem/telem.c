@@ -0,0 +1,236 @@
+/*
+    Copyright (C) 2010  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "../data.h"
+#include "monitor.h"
+#include "telem.h"
+
+/*
+ * $$A2,<INCREMENTAL COUNTER ID>,<UPTIME HHH:MM:SS>,
+ *   <RSSI MEAN>,<RSSI MIN>,<RSSI MAX>,<RSSI VARIANCE>,
+ *   <SUPPLY MEAN>,<SUPPLY MIN>,<SUPPLY MAX>,<SUPPLY VARIANCE>
+ *   *<XOR CHECKSUM HEX>\n
+ *
+ * (all on one line). The RSSI and supply fields cover the second before
+ * the sentence was rendered, in the raw units of telem/monitor.h.
+ *
+ * The sentence is rendered in one go into one of two buffers, outside of
+ * any ISR (all but the checksum, which telem_source adds as it goes out),
+ * and then published by swapping telem_ready. telem_body (which runs in
+ * the radio ISR) latches telem_ready at the start of each sentence and
+ * holds it until it is called again after returning it as a span, so a
+ * transmission never sees a half-updated sentence.
+ *
+ * The writer always renders into the buffer the reader isn't holding. If
+ * that happens to be the one published, it is withdrawn first (the reader
+ * would get the older, complete one until the new one is done).
+ * Pointers are two bytes, so the writer does its pointer work with
+ * interrupts off; the reader is the radio ISR, so can't be interrupted by
+ * the writer anyway.
+ */
+
+struct telem_buffer
+{
+    uint8_t len;
+    uint8_t data[TELEM_MAX_LEN];
+};
+
+static struct telem_buffer telem_buffers[2];
+static struct telem_buffer *volatile telem_ready;
+/* NULL between sentences */
+static struct telem_buffer *volatile telem_reading;
+/* telem_ready hasn't started going out yet */
+static volatile uint8_t telem_new;
+
+static uint16_t telem_id;
+static uint32_t telem_uptime;
+
+static uint8_t telem_next(struct data_source *source,
+                          struct data_span *span);
+static void telem_render(struct telem_buffer *buf);
+static void telem_put_stats(struct telem_buffer *buf,
+                            const struct monitor_stats *stats);
+static void telem_put(struct telem_buffer *buf, uint8_t c);
+static void telem_put_uint(struct telem_buffer *buf, uint32_t value,
+                           uint8_t digits);
+
+static struct data_source telem_body = { telem_next };
+
+/* Checksum covers everything between the $$ and the * */
+struct data_checksum telem_source =
+    DATA_CHECKSUM(&telem_body, DATA_CHECKSUM_XOR, 2);
+
+static char telem_status_type[] PROGMEM = ">";
+static struct data_flash telem_status_type_source =
+    DATA_FLASH((const uint8_t *) telem_status_type,
+               sizeof(telem_status_type) - 1);
+static struct data_source *const telem_status_parts[] =
+    { &telem_status_type_source.source, &telem_body };
+struct data_concat telem_status = DATA_CONCAT(telem_status_parts, 2);
+
+void telem_init()
+{
+    telem_render(&telem_buffers[0]);
+    telem_ready = &telem_buffers[0];
+    telem_new = 1;
+}
+
+void telem_update()
+{
+    struct telem_buffer *back;
+
+    telem_uptime++;
+
+    cli();
+
+    if (telem_reading == &telem_buffers[0] ||
+        (telem_reading == NULL && telem_ready == &telem_buffers[0]))
+    {
+        back = &telem_buffers[1];
+    }
+    else
+    {
+        back = &telem_buffers[0];
+    }
+
+    if (telem_ready == back)
+    {
+        telem_ready = telem_reading;
+    }
+
+    sei();
+
+    telem_render(back);
+
+    cli();
+    telem_ready = back;
+    telem_new = 1;
+    sei();
+}
+
+static uint8_t telem_next(struct data_source *source,
+                          struct data_span *span)
+{
+    if (telem_reading != NULL)
+    {
+        telem_reading = NULL;
+        return DATA_SOURCE_FINISHED;
+    }
+
+    telem_reading = telem_ready;
+    telem_new = 0;
+    span->data = telem_reading->data;
+    span->len = telem_reading->len;
+    span->flags = DATA_SPAN_RAM;
+    return DATA_SOURCE_OK;
+}
+
+uint8_t telem_fresh()
+{
+    return telem_new;
+}
+
+/* Plus *FF\n */
+uint16_t telem_length()
+{
+    return telem_ready->len + 4;
+}
+
+/* Plus the > */
+uint16_t telem_status_length()
+{
+    return telem_ready->len + 1;
+}
+
+static void telem_render(struct telem_buffer *buf)
+{
+    buf->len = 0;
+
+    telem_put(buf, '$');
+    telem_put(buf, '$');
+    telem_put(buf, 'A');
+    telem_put(buf, '2');
+    telem_put(buf, ',');
+    telem_put_uint(buf, telem_id, 0);
+    telem_put(buf, ',');
+    telem_put_uint(buf, telem_uptime / 3600, 2);
+    telem_put(buf, ':');
+    telem_put_uint(buf, (telem_uptime / 60) % 60, 2);
+    telem_put(buf, ':');
+    telem_put_uint(buf, telem_uptime % 60, 2);
+    telem_put_stats(buf, &monitor_stats[MONITOR_RSSI]);
+    telem_put_stats(buf, &monitor_stats[MONITOR_SUPPLY]);
+
+    telem_id++;
+}
+
+static void telem_put_stats(struct telem_buffer *buf,
+                            const struct monitor_stats *stats)
+{
+    telem_put(buf, ',');
+    telem_put_uint(buf, stats->mean, 0);
+    telem_put(buf, ',');
+    telem_put_uint(buf, stats->min, 0);
+    telem_put(buf, ',');
+    telem_put_uint(buf, stats->max, 0);
+    telem_put(buf, ',');
+    telem_put_uint(buf, stats->variance, 0);
+}
+
+static void telem_put(struct telem_buffer *buf, uint8_t c)
+{
+    if (buf->len < TELEM_MAX_LEN)
+    {
+        buf->data[buf->len] = c;
+        buf->len++;
+    }
+}
+
+/* Decimal, zero padded to at least digits */
+static void telem_put_uint(struct telem_buffer *buf, uint32_t value,
+                           uint8_t digits)
+{
+    uint8_t tmp[10];
+    uint8_t n;
+
+    n = 0;
+
+    do
+    {
+        tmp[n] = '0' + (value % 10);
+        value /= 10;
+        n++;
+    }
+    while (value != 0);
+
+    while (n < digits)
+    {
+        tmp[n] = '0';
+        n++;
+    }
+
+    while (n != 0)
+    {
+        n--;
+        telem_put(buf, tmp[n]);
+    }
+}
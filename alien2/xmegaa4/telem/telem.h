@@ -0,0 +1,50 @@
+/*
+    Copyright (C) 2010  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License, 
+    see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TELEM_TELEM_H__
+#define __TELEM_TELEM_H__
+
+#include <stdint.h>
+#include "../data.h"
+
+/*
+ * $$A2,65535,999:59:59*FF\n is 24, and the monitor fields (see telem.c) at
+ * most 58 more; leave room for more fields
+ */
+#define TELEM_MAX_LEN 96
+
+/*
+ * telem_init renders the first sentence and must be called before
+ * interrupts are enabled. After that, telem_update renders a fresh one
+ * and should be called once a second from outside of any ISR.
+ * telem_source serves the newest complete sentence to the radio, and
+ * telem_length says how long it is (for the scheduler). telem_fresh is
+ * true if that sentence hasn't been sent yet (see struct data_mux).
+ *
+ * telem_status is the same sentence as an APRS status report, without the
+ * checksum and newline (the AX.25 frame has its own).
+ */
+extern struct data_checksum telem_source;
+extern struct data_concat telem_status;
+
+void telem_init();
+void telem_update();
+uint8_t telem_fresh();
+uint16_t telem_length();
+uint16_t telem_status_length();
+
+#endif
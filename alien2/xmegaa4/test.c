@@ -18,28 +18,188 @@
 #include <stdint.h>
 #include <avr/pgmspace.h>
 #include "data.h"
+#include "test.h"
 
 static uint8_t test_string[] PROGMEM =
     "Hello, world! This is the ALIEN-2 test program. It will output this "
     "string in a variety of modes: DominoEX22, RTTY50, RTTY300, "
     "Feldhellschreiber and Morse.\n"
     "I plan to also implement an uplink in rtty and SSTV\n";
-static uint8_t test_position;
 
-uint8_t test_source(uint8_t *b)
+struct data_flash test_source =
+    DATA_FLASH(test_string, sizeof(test_string) - 1);
+
+/* The test string twice over, then its CRC */
+static struct data_repeat test_repeat =
+    DATA_REPEAT(&test_source.source, 2);
+struct data_checksum test_twice =
+    DATA_CHECKSUM(&test_repeat.source, DATA_CHECKSUM_CRC16, 0);
+
+uint16_t test_twice_length()
 {
-    uint8_t data;
-    data = pgm_read_byte(&(test_string[test_position]));
+    return (sizeof(test_string) - 1) * 2 + 6;
+}
+
+/*
+ * A test card for SSTV (see radio/sstv.c): colour bars over the top half,
+ * then a grey ramp, then a chequerboard. Pixels come in the order they are
+ * sent: green, blue then red for each line. It wraps around rather than
+ * finishing, since sstv stops reading at the end of each frame. Pixels
+ * are rendered TEST_IMAGE_RUN at a time, and served as a span.
+ */
+#define TEST_IMAGE_WIDTH 320
+#define TEST_IMAGE_LINES 256
+#define TEST_IMAGE_BAR   40
+#define TEST_IMAGE_CHECK 20
+#define TEST_IMAGE_RUN   32
 
-    if (data == '\0')
+/* White, yellow, cyan, green, magenta, red, blue, black; { g, b, r } */
+static uint8_t test_image_bars[] PROGMEM =
+    { 255, 255, 255,   255, 0, 255,   255, 255, 0,   255, 0, 0,
+      0, 255, 255,     0, 0, 255,     0, 255, 0,     0, 0, 0 };
+static uint16_t test_image_x, test_image_y;
+static uint8_t test_image_channel;
+static uint8_t test_image_run[TEST_IMAGE_RUN];
+
+static uint8_t test_image_next(struct data_source *source,
+                               struct data_span *span);
+static uint8_t test_image_pixel();
+
+struct data_source test_image_source = { test_image_next };
+
+static uint8_t test_image_next(struct data_source *source,
+                               struct data_span *span)
+{
+    uint8_t i;
+
+    for (i = 0; i < TEST_IMAGE_RUN; i++)
     {
-        test_position = 0;
-        return DATA_SOURCE_FINISHED;
+        test_image_run[i] = test_image_pixel();
+    }
+
+    span->data = test_image_run;
+    span->len = TEST_IMAGE_RUN;
+    span->flags = DATA_SPAN_RAM;
+    return DATA_SOURCE_OK;
+}
+
+static uint8_t test_image_pixel()
+{
+    uint16_t x, y;
+    uint8_t c;
+
+    x = test_image_x;
+    y = test_image_y;
+
+    if (y < TEST_IMAGE_LINES / 2)
+    {
+        c = pgm_read_byte(&(test_image_bars[((x / TEST_IMAGE_BAR) * 3) +
+                                            test_image_channel]));
+    }
+    else if (y < (TEST_IMAGE_LINES * 3) / 4)
+    {
+        /* 0 to 255 across the width */
+        c = (x * 4) / 5;
+    }
+    else if (((x / TEST_IMAGE_CHECK) ^ (y / TEST_IMAGE_CHECK)) & 0x01)
+    {
+        c = 255;
     }
     else
     {
-        *b = data;
-        test_position++;
-        return DATA_SOURCE_OK;
+        c = 0;
+    }
+
+    test_image_x++;
+
+    if (test_image_x == TEST_IMAGE_WIDTH)
+    {
+        test_image_x = 0;
+        test_image_channel++;
+
+        if (test_image_channel == 3)
+        {
+            test_image_channel = 0;
+            test_image_y++;
+
+            if (test_image_y == TEST_IMAGE_LINES)
+            {
+                test_image_y = 0;
+            }
+        }
     }
+
+    return c;
 }
+
+/*
+ * A JPEG for SSDV (see ssdv/ssdv.c): much the same test card, 128x96,
+ * from libjpeg at quality 50 (so with the standard tables), 4:2:0.
+ */
+#define TEST_JPEG_LEN 990
+
+static uint8_t test_jpeg[TEST_JPEG_LEN] PROGMEM =
+    "\xff\xd8\xff\xe0\x00\x10\x4a\x46\x49\x46\x00\x01\x01\x00\x00\x01"
+    "\x00\x01\x00\x00\xff\xdb\x00\x43\x00\x10\x0b\x0c\x0e\x0c\x0a\x10"
+    "\x0e\x0d\x0e\x12\x11\x10\x13\x18\x28\x1a\x18\x16\x16\x18\x31\x23"
+    "\x25\x1d\x28\x3a\x33\x3d\x3c\x39\x33\x38\x37\x40\x48\x5c\x4e\x40"
+    "\x44\x57\x45\x37\x38\x50\x6d\x51\x57\x5f\x62\x67\x68\x67\x3e\x4d"
+    "\x71\x79\x70\x64\x78\x5c\x65\x67\x63\xff\xdb\x00\x43\x01\x11\x12"
+    "\x12\x18\x15\x18\x2f\x1a\x1a\x2f\x63\x42\x38\x42\x63\x63\x63\x63"
+    "\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63"
+    "\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63"
+    "\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\x63\xff\xc0"
+    "\x00\x11\x08\x00\x60\x00\x80\x03\x01\x22\x00\x02\x11\x01\x03\x11"
+    "\x01\xff\xc4\x00\x1f\x00\x00\x01\x05\x01\x01\x01\x01\x01\x01\x00"
+    "\x00\x00\x00\x00\x00\x00\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09"
+    "\x0a\x0b\xff\xc4\x00\xb5\x10\x00\x02\x01\x03\x03\x02\x04\x03\x05"
+    "\x05\x04\x04\x00\x00\x01\x7d\x01\x02\x03\x00\x04\x11\x05\x12\x21"
+    "\x31\x41\x06\x13\x51\x61\x07\x22\x71\x14\x32\x81\x91\xa1\x08\x23"
+    "\x42\xb1\xc1\x15\x52\xd1\xf0\x24\x33\x62\x72\x82\x09\x0a\x16\x17"
+    "\x18\x19\x1a\x25\x26\x27\x28\x29\x2a\x34\x35\x36\x37\x38\x39\x3a"
+    "\x43\x44\x45\x46\x47\x48\x49\x4a\x53\x54\x55\x56\x57\x58\x59\x5a"
+    "\x63\x64\x65\x66\x67\x68\x69\x6a\x73\x74\x75\x76\x77\x78\x79\x7a"
+    "\x83\x84\x85\x86\x87\x88\x89\x8a\x92\x93\x94\x95\x96\x97\x98\x99"
+    "\x9a\xa2\xa3\xa4\xa5\xa6\xa7\xa8\xa9\xaa\xb2\xb3\xb4\xb5\xb6\xb7"
+    "\xb8\xb9\xba\xc2\xc3\xc4\xc5\xc6\xc7\xc8\xc9\xca\xd2\xd3\xd4\xd5"
+    "\xd6\xd7\xd8\xd9\xda\xe1\xe2\xe3\xe4\xe5\xe6\xe7\xe8\xe9\xea\xf1"
+    "\xf2\xf3\xf4\xf5\xf6\xf7\xf8\xf9\xfa\xff\xc4\x00\x1f\x01\x00\x03"
+    "\x01\x01\x01\x01\x01\x01\x01\x01\x01\x00\x00\x00\x00\x00\x00\x01"
+    "\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\xff\xc4\x00\xb5\x11\x00"
+    "\x02\x01\x02\x04\x04\x03\x04\x07\x05\x04\x04\x00\x01\x02\x77\x00"
+    "\x01\x02\x03\x11\x04\x05\x21\x31\x06\x12\x41\x51\x07\x61\x71\x13"
+    "\x22\x32\x81\x08\x14\x42\x91\xa1\xb1\xc1\x09\x23\x33\x52\xf0\x15"
+    "\x62\x72\xd1\x0a\x16\x24\x34\xe1\x25\xf1\x17\x18\x19\x1a\x26\x27"
+    "\x28\x29\x2a\x35\x36\x37\x38\x39\x3a\x43\x44\x45\x46\x47\x48\x49"
+    "\x4a\x53\x54\x55\x56\x57\x58\x59\x5a\x63\x64\x65\x66\x67\x68\x69"
+    "\x6a\x73\x74\x75\x76\x77\x78\x79\x7a\x82\x83\x84\x85\x86\x87\x88"
+    "\x89\x8a\x92\x93\x94\x95\x96\x97\x98\x99\x9a\xa2\xa3\xa4\xa5\xa6"
+    "\xa7\xa8\xa9\xaa\xb2\xb3\xb4\xb5\xb6\xb7\xb8\xb9\xba\xc2\xc3\xc4"
+    "\xc5\xc6\xc7\xc8\xc9\xca\xd2\xd3\xd4\xd5\xd6\xd7\xd8\xd9\xda\xe2"
+    "\xe3\xe4\xe5\xe6\xe7\xe8\xe9\xea\xf2\xf3\xf4\xf5\xf6\xf7\xf8\xf9"
+    "\xfa\xff\xda\x00\x0c\x03\x01\x00\x02\x11\x03\x11\x00\x3f\x00\xf4"
+    "\x0a\x28\xa2\x80\x28\x51\x45\x15\xf0\x67\x51\x91\x45\x14\x57\xea"
+    "\x07\xe7\x25\x0a\x28\xa2\xbe\x0c\xea\x32\x28\xa2\x8a\xfd\x40\xfd"
+    "\x90\xa3\x45\x14\x57\xc1\x9d\x46\x3d\x14\x51\x5f\xa8\x1f\x9c\x94"
+    "\x68\xa2\x8a\xf8\x33\xa8\xfa\x02\x8a\x28\xa0\x0a\x14\x51\x45\x7c"
+    "\x19\xd4\x64\x51\x45\x15\xfa\x81\xf9\xc9\x42\x8a\x28\xaf\x83\x3a"
+    "\x8c\x8a\x28\xa2\xbf\x50\x3f\x64\x28\xd1\x45\x15\xf0\x67\x51\x8f"
+    "\x45\x14\x57\xea\x07\xe7\x25\x1a\x28\xa2\xbe\x0c\xea\x3e\x80\xa2"
+    "\x8a\x28\x02\x85\x14\x51\x5f\x06\x75\x19\x14\x51\x45\x7e\xa0\x7e"
+    "\x72\x50\xa2\x8a\x2b\xe0\xce\xa3\x22\x8a\x28\xaf\xd4\x0f\xd9\x0a"
+    "\x34\x51\x45\x7c\x19\xd4\x63\xd1\x45\x15\xfa\x81\xf9\xc9\x46\x8a"
+    "\x28\xaf\x83\x3a\x87\xa5\x58\x4a\xae\x95\x61\x28\x02\xc2\x55\x84"
+    "\xaa\xe9\x56\x12\x80\x2c\x25\x58\x4a\xae\x95\x61\x28\x02\xc2\x55"
+    "\x84\xaa\xe9\x56\x12\x80\x2c\xa5\x58\x4a\xae\x95\x61\x28\x02\xc2"
+    "\x55\x84\xaa\xe9\x56\x12\x80\x2c\x25\x58\x4a\xae\x95\x61\x28\x02"
+    "\xc2\x55\x84\xaa\xe9\x56\x12\x80\x3c\x19\x2a\xc2\x57\xba\xd7\xcf"
+    "\xf4\x01\xa6\x95\x61\x2b\xd9\x6b\xe7\xfa\x00\xe8\xd2\xac\x25\x7a"
+    "\xad\x7c\xff\x00\x40\x1d\x9a\x55\x84\xaf\x45\xaf\x9f\xe8\x03\xd1"
+    "\x12\xac\x25\x76\x95\xf3\xfd\x00\x7a\xa2\x55\x84\xae\x92\xbe\x7f"
+    "\xa0\x0f\x64\x4a\xb0\x95\xa9\x5f\x3f\xd0\x07\xba\x25\x58\x4a\x92"
+    "\xbe\x7f\xa0\x02\xbe\x80\xa2\xbe\x7f\xa0\x02\xbe\x80\xa2\xbe\x7f"
+    "\xa0\x02\xbe\x80\xa2\xbe\x7f\xa0\x02\xbe\x80\xa2\xbe\x7f\xa0\x02"
+    "\xbe\x80\xa2\xbe\x7f\xa0\x02\xbe\x80\xa2\xbe\x7f\xa0\x02\xbe\x80"
+    "\xa2\xbe\x7f\xa0\x02\xbe\x80\xa2\xbe\x7f\xa0\x0f\xff\xd9";
+
+struct data_flash test_jpeg_source = DATA_FLASH(test_jpeg, TEST_JPEG_LEN);
@@ -21,6 +21,11 @@
 #include <stdint.h>
 #include "data.h"
 
-uint8_t test_source(uint8_t *b);
+extern struct data_flash test_source;
+extern struct data_checksum test_twice;
+extern struct data_source test_image_source;
+extern struct data_flash test_jpeg_source;
+
+uint16_t test_twice_length();
 
 #endif
@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Prints the sine table for /alien2/xmegaa4/radio/aprs.c: one cycle in 64
+ * steps, scaled to +-127.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#define STEPS 64
+
+int main(int argc, char **argv)
+{
+  int i;
+
+  printf("static int8_t aprs_sine[%i] PROGMEM =\n", STEPS);
+
+  for (i = 0; i < STEPS; i++)
+  {
+    if (i % 8 == 0)
+    {
+      printf("    %s", i == 0 ? "{ " : "  ");
+    }
+
+    printf("%4li", lround(127 * sin(2 * M_PI * i / STEPS)));
+
+    if (i == STEPS - 1)
+    {
+      printf(" };\n");
+    }
+    else if (i % 8 == 7)
+    {
+      printf(",\n");
+    }
+    else
+    {
+      printf(", ");
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Prints the tables for the RS(255,223) encoder in
+ * /alien2/xmegaa4/ssdv/rs8.c: GF(256) antilogs and logs, and the generator
+ * polynomial (in log form). The parameters are those of Phil Karn's
+ * encode_rs_8 (field polynomial 0x187, first root 112, primitive
+ * element 11, 32 roots), which is what SSDV uses.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define NN     255
+#define A0     NN
+#define GFPOLY 0x187
+#define FCR    112
+#define PRIM   11
+#define NROOTS 32
+
+static uint8_t alpha_to[NN + 1], index_of[NN + 1], genpoly[NROOTS + 1];
+
+static int modnn(int x)
+{
+  while (x >= NN)
+  {
+    x -= NN;
+  }
+
+  return x;
+}
+
+void do_it(char *name, uint8_t *array, int len)
+{
+  int i;
+
+  printf("%s\n", name);
+
+  for (i = 0; i < len; i++)
+  {
+    if (i % 16 == 0)
+    {
+      printf("    \"");
+    }
+
+    printf("\\x%02x", array[i]);
+
+    if (i % 16 == 15 || i == len - 1)
+    {
+      printf("\"\n");
+    }
+  }
+
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  int i, j, sr, root;
+
+  index_of[0] = A0;
+  alpha_to[A0] = 0;
+  sr = 1;
+
+  for (i = 0; i < NN; i++)
+  {
+    index_of[sr] = i;
+    alpha_to[i] = sr;
+    sr <<= 1;
+
+    if (sr & 0x100)
+    {
+      sr ^= GFPOLY;
+    }
+
+    sr &= NN;
+  }
+
+  if (sr != 1)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  genpoly[0] = 1;
+
+  for (i = 0, root = FCR * PRIM; i < NROOTS; i++, root += PRIM)
+  {
+    genpoly[i + 1] = 1;
+
+    for (j = i; j > 0; j--)
+    {
+      if (genpoly[j] != 0)
+      {
+        genpoly[j] = genpoly[j - 1] ^
+                     alpha_to[modnn(index_of[genpoly[j]] + root)];
+      }
+      else
+      {
+        genpoly[j] = genpoly[j - 1];
+      }
+    }
+
+    genpoly[0] = alpha_to[modnn(index_of[genpoly[0]] + root)];
+  }
+
+  for (i = 0; i <= NROOTS; i++)
+  {
+    genpoly[i] = index_of[genpoly[i]];
+  }
+
+  do_it("alpha_to", alpha_to, NN + 1);
+  do_it("index_of", index_of, NN + 1);
+  do_it("genpoly", genpoly, NROOTS + 1);
+  return 0;
+}
@@ -0,0 +1,265 @@
+/*
+    Copyright (C) 2011  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The varicode table for /alien2/xmegaa4/radio/thor.c, from fldigi's:
+ *
+ *   ./thor fldigi/src/thor/thorvaricode.cxx \
+ *       > alien2/xmegaa4/radio/thor_varicode.h
+ *
+ * writes the table, and
+ *
+ *   ./thor fldigi/src/thor/thorvaricode.cxx \
+ *       alien2/xmegaa4/radio/thor_varicode.h
+ *
+ * checks it: it encodes a test string with both and compares the bit
+ * streams, printing the first difference. It exits non-zero if they
+ * differ (or if either table can't be read). THOR is only built once
+ * thor_varicode.h exists.
+ *
+ * fldigi's table is an array of strings of '0's and '1's, the primary
+ * character set (the first 256 of them) before the secondary one; its
+ * thor::sendchar sends a character's string bit by bit, and nothing else.
+ * thor.c sends the same bits from a uint16_t per character: since every
+ * code starts with a 1, the length is the position of the highest set
+ * bit. A code that doesn't start with a 1 or is longer than 16 bits
+ * can't be stored like that, and is reported as an error.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CODES     256
+#define MAX_FILE  (256 * 1024)
+
+static const char test_string[] =
+  "$$A2,1234,001:02:03,2000,1990,2010,25,2730,2728,2732,1*5C\n"
+  "The quick brown fox jumps over the lazy dog. 0123456789 !?@#%&()[]{}";
+
+static char file[MAX_FILE];
+
+static size_t read_file(const char *name)
+{
+  FILE *f;
+  size_t len;
+
+  f = fopen(name, "r");
+
+  if (f == NULL)
+  {
+    perror(name);
+    exit(2);
+  }
+
+  len = fread(file, 1, sizeof(file) - 1, f);
+  file[len] = '\0';
+  fclose(f);
+
+  return len;
+}
+
+/* The first CODES strings of only '0's and '1's in fldigi's file */
+static void read_fldigi(const char *name, uint16_t *table)
+{
+  char *p, *end;
+  int n, len;
+  uint16_t code;
+
+  read_file(name);
+  p = file;
+  n = 0;
+
+  while (n < CODES && (p = strchr(p, '"')) != NULL)
+  {
+    p++;
+    end = strchr(p, '"');
+
+    if (end == NULL)
+    {
+      break;
+    }
+
+    len = end - p;
+
+    if (len != 0 && (int) strspn(p, "01") == len)
+    {
+      if (p[0] != '1' || len > 16)
+      {
+        fprintf(stderr, "%s: code %i (\"%.*s\") doesn't fit a uint16_t\n",
+                name, n, len, p);
+        exit(2);
+      }
+
+      for (code = 0; p != end; p++)
+      {
+        code = (code << 1) | (*p - '0');
+      }
+
+      table[n] = code;
+      n++;
+    }
+
+    p = end + 1;
+  }
+
+  if (n != CODES)
+  {
+    fprintf(stderr, "%s: only found %i codes\n", name, n);
+    exit(2);
+  }
+}
+
+/* The CODES numbers after "varicode[256] PROGMEM =" in thor_varicode.h */
+static void read_thor(const char *name, uint16_t *table)
+{
+  char *p, *end;
+  int n;
+
+  read_file(name);
+  p = strstr(file, "varicode[256] PROGMEM =");
+
+  if (p == NULL)
+  {
+    fprintf(stderr, "%s: no varicode table\n", name);
+    exit(2);
+  }
+
+  p = strchr(p, '{');
+
+  for (n = 0; p != NULL && n < CODES; n++)
+  {
+    table[n] = strtoul(p + 1, &end, 0);
+
+    if (end == p + 1)
+    {
+      break;
+    }
+
+    p = strpbrk(end, ",}");
+  }
+
+  if (n != CODES)
+  {
+    fprintf(stderr, "%s: only found %i codes\n", name, n);
+    exit(2);
+  }
+}
+
+static void print_table(const uint16_t *table)
+{
+  int i;
+
+  printf("/* Generated by /misc-c/pc/tables/thor.c from fldigi's "
+         "thorvaricode.cxx */\n");
+  printf("static uint16_t varicode[256] PROGMEM =\n");
+
+  for (i = 0; i < CODES; i++)
+  {
+    if (i % 8 == 0)
+    {
+      printf("    %s", i == 0 ? "{ " : "  ");
+    }
+
+    printf("0x%04x", table[i]);
+
+    if (i == CODES - 1)
+    {
+      printf(" };\n");
+    }
+    else if (i % 8 == 7)
+    {
+      printf(",\n");
+    }
+    else
+    {
+      printf(", ");
+    }
+  }
+}
+
+/* Appends the bits of code, MSB first, to bits as '0's and '1's */
+static char *put_code(char *bits, uint16_t code)
+{
+  int n;
+
+  for (n = 15; n > 0 && !(code & (1 << n)); n--);
+
+  for (; n >= 0; n--)
+  {
+    *bits++ = (code & (1 << n)) ? '1' : '0';
+  }
+
+  *bits = '\0';
+  return bits;
+}
+
+static int check(const uint16_t *fldigi, const uint16_t *thor)
+{
+  static char a[sizeof(test_string) * 16], b[sizeof(test_string) * 16];
+  char *pa, *pb, *ca, *cb;
+  size_t i, n;
+  uint8_t c;
+
+  pa = a;
+  pb = b;
+
+  for (i = 0; test_string[i] != '\0'; i++)
+  {
+    c = test_string[i];
+    ca = pa;
+    cb = pb;
+    pa = put_code(pa, fldigi[c]);
+    pb = put_code(pb, thor[c]);
+
+    if (strcmp(a, b) != 0)
+    {
+      for (n = 0; a[n] == b[n]; n++);
+
+      printf("bit %zu differs, in character %zu (0x%02x): fldigi sends %s, "
+             "thor_varicode.h sends %s\n", n, i, c, ca, cb);
+      return 1;
+    }
+  }
+
+  printf("%zu characters, %zu bits: same\n", i, strlen(a));
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  static uint16_t fldigi[CODES], thor[CODES];
+
+  if (argc != 2 && argc != 3)
+  {
+    fprintf(stderr, "Usage: %s thorvaricode.cxx [thor_varicode.h]\n",
+            argv[0]);
+    return 2;
+  }
+
+  read_fldigi(argv[1], fldigi);
+
+  if (argc == 2)
+  {
+    print_table(fldigi);
+    return 0;
+  }
+
+  read_thor(argv[2], thor);
+  return check(fldigi, thor);
+}
@@ -0,0 +1,321 @@
+/*
+    Copyright (C) 2010  Daniel Richman
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a full copy of the GNU General Public License,
+    see <http://www.gnu.org/licenses/>.
+*/
+
+/* Decodes the trace records that alien2 sends over debug (see
+ * debug/trace.h there): text, overflows, radio airtime stats, ISR profiles
+ * (PROFILE=1 builds), uplink frames and link quality. Each line starts
+ * with the record's seq and time in seconds; gaps in seq are reported as
+ * drops. Record times are 32 bit CPU cycle counts, which wrap every 537s;
+ * they're unwrapped here by counting a wrap whenever one goes backwards
+ * (records are stamped in the order they're sent).
+ *
+ *   ./tracedump < debug.bin */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define F_CPU          8000000.0
+#define MAX_DATA       (1024 * 1024)
+
+#define SYNC           0xA5
+#define HEADER_LEN     9
+
+#define TEXT           0x01
+#define OVERFLOW       0x02
+#define RADIO_STATS    0x03
+#define PROFILE        0x04
+#define UPLINK         0x05
+#define LINK           0x06
+
+#define STATS_UNIT     1024.0
+#define STATS_PHASES   5
+#define STATS_LEN      (11 + (4 * STATS_PHASES))
+
+#define PROFILE_PERIOD 10.0  /* PROFILE_PERIOD, seconds */
+#define BUCKETS        8
+#define PROFILE_LEN    (12 + (2 * BUCKETS))
+
+#define LINK_LEN       6
+
+static const char *phase_names[STATS_PHASES] =
+  { "morse", "predelay", "running", "announce", "postdelay" };
+static const char *link_names[] = { "poor", "fair", "good" };
+
+static uint8_t data[MAX_DATA];
+
+static uint32_t get_uint(const uint8_t *p, int len)
+{
+  uint32_t v;
+  int i;
+
+  v = 0;
+
+  for (i = len - 1; i >= 0; i--)
+  {
+    v = (v << 8) | p[i];
+  }
+
+  return v;
+}
+
+/* Returns the length of the record at p, or 0 if it isn't a valid one */
+static size_t check_record(const uint8_t *p, size_t avail)
+{
+  size_t len, i;
+  uint8_t checksum;
+
+  if (avail < HEADER_LEN + 1 || p[0] != SYNC)
+  {
+    return 0;
+  }
+
+  len = HEADER_LEN + p[2];
+
+  if (len + 1 > avail)
+  {
+    return 0;
+  }
+
+  checksum = 0;
+
+  for (i = 1; i < len; i++)
+  {
+    checksum ^= p[i];
+  }
+
+  if (checksum != p[len])
+  {
+    return 0;
+  }
+
+  return len + 1;
+}
+
+static void print_text(const uint8_t *e, int len)
+{
+  int i;
+
+  printf("text \"");
+
+  for (i = 0; i < len; i++)
+  {
+    if (e[i] == '\n')
+    {
+      printf("\\n");
+    }
+    else if (e[i] < 0x20 || e[i] >= 0x7F)
+    {
+      printf("\\x%02x", e[i]);
+    }
+    else
+    {
+      putchar(e[i]);
+    }
+  }
+
+  printf("\"\n");
+}
+
+static void print_radio_stats(const uint8_t *e, int len)
+{
+  uint32_t t, bytes, switches;
+  double total, overhead, running, seconds;
+  int j;
+
+  if (len < STATS_LEN)
+  {
+    printf("stats (short)\n");
+    return;
+  }
+
+  total = (get_uint(e, 4) * STATS_UNIT) / F_CPU;
+  switches = get_uint(e + 5, 2);
+  bytes = get_uint(e + 7, 4);
+
+  printf("stats %.*s opt %d switches %u bytes %u |",
+         len - STATS_LEN, (const char *) e + STATS_LEN, e[4],
+         switches, bytes);
+
+  overhead = 0;
+  running = 0;
+
+  for (j = 0; j < STATS_PHASES; j++)
+  {
+    t = get_uint(e + 11 + (4 * j), 4);
+    seconds = (t * STATS_UNIT) / F_CPU;
+    printf(" %s %.1fs", phase_names[j], seconds);
+
+    if (j == 2)
+    {
+      running = seconds;
+    }
+    else
+    {
+      overhead += seconds;
+    }
+  }
+
+  /* Goodput over all of the time spent on this mode, overhead included */
+  printf(" | %.2f bytes/s, %.1f%% of %.1fs\n",
+         running + overhead > 0 ? bytes / (running + overhead) : 0.0,
+         total > 0 ? ((running + overhead) * 100) / total : 0.0, total);
+}
+
+static void print_profile(const uint8_t *e, int len)
+{
+  uint32_t count, total;
+  uint16_t min, max;
+  int i;
+
+  if (len < PROFILE_LEN)
+  {
+    printf("profile (short)\n");
+    return;
+  }
+
+  count = get_uint(e, 4);
+  total = get_uint(e + 4, 4);
+  min = get_uint(e + 8, 2);
+  max = get_uint(e + 10, 2);
+
+  /* Average, and the share of the CPU used */
+  printf("profile %-8.*s count %u min %u avg %.1f max %u cpu %.2f%% |",
+         len - PROFILE_LEN, (const char *) e + PROFILE_LEN, count, min,
+         count > 0 ? (double) total / count : 0.0, max,
+         (total * 100.0) / (F_CPU * PROFILE_PERIOD));
+
+  /* Buckets: <128, <256, <512, <1k, <2k, <4k, <8k, more (cycles) */
+  for (i = 0; i < BUCKETS; i++)
+  {
+    printf(" %u", get_uint(e + 12 + (2 * i), 2));
+  }
+
+  printf("\n");
+}
+
+static void print_link(const uint8_t *e, int len)
+{
+  unsigned int link;
+
+  if (len < LINK_LEN)
+  {
+    printf("link (short)\n");
+    return;
+  }
+
+  link = e[5];
+
+  /* Clear is out of 256 */
+  printf("link heard %u rssi %u clear %.1f%% | %s\n",
+         get_uint(e, 2), get_uint(e + 2, 2), e[4] * 100.0 / 256,
+         link < 3 ? link_names[link] : "?");
+}
+
+static void print_record(const uint8_t *p, uint64_t time)
+{
+  const uint8_t *e;
+  int len;
+
+  len = p[2];
+  e = p + HEADER_LEN;
+
+  printf("%5u %10.6f ", get_uint(p + 3, 2), time / F_CPU);
+
+  switch (p[1])
+  {
+    case TEXT:
+      print_text(e, len);
+      break;
+
+    case OVERFLOW:
+      printf("overflow, %u dropped so far\n", get_uint(e, 2));
+      break;
+
+    case RADIO_STATS:
+      print_radio_stats(e, len);
+      break;
+
+    case PROFILE:
+      print_profile(e, len);
+      break;
+
+    case UPLINK:
+      printf("uplink \"%.*s\"\n", len, (const char *) e);
+      break;
+
+    case LINK:
+      print_link(e, len);
+      break;
+
+    default:
+      printf("unknown type 0x%02x, %d bytes\n", p[1], len);
+      break;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t len, pos, record_len;
+  uint16_t seq, expect;
+  uint32_t time, last_time;
+  uint64_t wraps;
+  int first;
+
+  len = fread(data, 1, sizeof(data), stdin);
+  pos = 0;
+  first = 1;
+  expect = 0;
+  last_time = 0;
+  wraps = 0;
+
+  while (pos < len)
+  {
+    record_len = check_record(data + pos, len - pos);
+
+    if (record_len == 0)
+    {
+      pos++;
+      continue;
+    }
+
+    seq = get_uint(data + pos + 3, 2);
+
+    if (!first && seq != expect)
+    {
+      printf("----- %u records dropped\n", (uint16_t) (seq - expect));
+    }
+
+    time = get_uint(data + pos + 5, 4);
+
+    if (!first && time < last_time)
+    {
+      wraps++;
+    }
+
+    last_time = time;
+
+    print_record(data + pos, (wraps << 32) + time);
+    pos += record_len;
+
+    first = 0;
+    expect = seq + 1;
+  }
+
+  return 0;
+}